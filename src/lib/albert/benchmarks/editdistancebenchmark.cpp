@@ -0,0 +1,205 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/*
+ * Replays the keystrokes of a query against the words of a corpus and prints
+ * the time the prefix edit distances of the fuzzy search take per keystroke,
+ * before (a matrix allocated per candidate) and after (bit-parallel, see
+ * PrefixEditDistance). Every word of the corpus is a candidate, which is the
+ * worst case of what the q-gram filter lets through.
+ *
+ * Usage: editdistancebenchmark [corpus [query]]
+ * The corpus has an item per line, e.g. the output of `find ~` for the files
+ * extension. Without a corpus 400000 synthetic paths are used. The query
+ * defaults to "porject reprot".
+ */
+
+#include <QString>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "prefixeditdistance.h"
+#include "tokenizer.h"
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The fuzzy search tolerates an error per three characters by default
+const double DELTA = 1.0/3;
+
+vector<string> syntheticCorpus(size_t size) {
+    const vector<string> names = {
+        "home", "user", "documents", "projects", "project", "report", "reports",
+        "repository", "src", "build", "photos", "music", "programs", "profile",
+        "draft", "invoice", "notes", "presentation", "release", "review"
+    };
+    const vector<string> extensions = { "txt", "pdf", "cpp", "h", "jpg", "md", "odt" };
+    std::mt19937 random(42);
+    std::uniform_int_distribution<size_t> name(0, names.size() - 1);
+    std::uniform_int_distribution<size_t> extension(0, extensions.size() - 1);
+    std::uniform_int_distribution<int> depth(2, 6);
+    std::uniform_int_distribution<int> number(0, 9999);
+
+    vector<string> corpus;
+    corpus.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        string path;
+        for (int d = depth(random); d > 0; --d)
+            path += "/" + names[name(random)];
+        path += "/" + names[name(random)] + "_" + std::to_string(number(random))
+                + "." + extensions[extension(random)];
+        corpus.push_back(path);
+    }
+    return corpus;
+}
+
+vector<QString> words(const string &text) {
+    vector<QString> result;
+    // The tokenizer scans the string in place, keep it alive
+    const QString string = QString::fromUtf8(text.data(), static_cast<int>(text.size()));
+    Core::Tokenizer tokenizer(string, true);
+    QString word;
+    while (tokenizer.next(word))
+        result.push_back(word);
+    return result;
+}
+
+// The check of FuzzySearch before, allocates a matrix per call
+bool checkPrefixEditDistance(const QString &prefix, const QString &str, uint delta) {
+    uint n = prefix.size() + 1;
+    uint m = std::min(prefix.size() + delta + 1, static_cast<uint>(str.size()) + 1);
+
+    uint* matrix = new uint[n*m];
+
+    // Initialize left and top row.
+    for (uint i = 0; i < n; ++i) { matrix[i*m+0] = i; }
+    for (uint i = 0; i < m; ++i) { matrix[0*m+i] = i; }
+
+    // Now fill the whole matrix.
+    for (uint i = 1; i < n; ++i) {
+        for (uint j = 1; j < m; ++j) {
+            uint dia = matrix[(i-1)*m+j-1] + (prefix[i-1] == str[j-1] ? 0 : 1);
+            matrix[i*m+j] = std::min(std::min(
+                                         dia,
+                                         matrix[i*m+j-1] + 1),
+                    matrix[(i-1)*m+j] + 1);
+        }
+    }
+
+    // Check the last row if there is an entry <= delta.
+    bool result = false;
+    for (uint j = 0; j < m; ++j) {
+        if (matrix[(n-1)*m+j] <= delta) {
+            result = true;
+            break;
+        }
+    }
+    delete[] matrix;
+    return result;
+}
+
+uint tolerance(const QString &word) {
+    return static_cast<uint>(word.size() * DELTA);
+}
+
+// The number of terms within the tolerance of every query word
+size_t matchBefore(const vector<QString> &terms, const vector<QString> &query) {
+    size_t matches = 0;
+    for (const QString &word : query)
+        for (const QString &term : terms)
+            if (checkPrefixEditDistance(word, term, tolerance(word)))
+                ++matches;
+    return matches;
+}
+
+size_t matchAfter(const vector<QString> &terms, const vector<QString> &query) {
+    size_t matches = 0;
+    for (const QString &word : query) {
+        const Core::PrefixEditDistance prefixEditDistance(word);
+        const uint delta = tolerance(word);
+        for (const QString &term : terms)
+            if (prefixEditDistance(term, delta) <= delta)
+                ++matches;
+    }
+    return matches;
+}
+
+// The runtime of function in microseconds
+template <typename Function>
+double measure(Function function, size_t &matches) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    matches = function();
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+}
+
+
+
+int main(int argc, char **argv) {
+
+    vector<string> corpus;
+    if (argc > 1) {
+        std::ifstream file(argv[1]);
+        if (!file) {
+            std::fprintf(stderr, "Could not open %s\n", argv[1]);
+            return 1;
+        }
+        string line;
+        while (std::getline(file, line))
+            corpus.push_back(line);
+    } else
+        corpus = syntheticCorpus(400000);
+    const string query = (argc > 2) ? argv[2] : "porject reprot";
+
+    // The dictionary of the fuzzy search
+    set<QString> dictionary;
+    for (const string &line : corpus)
+        for (const QString &word : words(line))
+            dictionary.insert(word);
+    const vector<QString> terms(dictionary.begin(), dictionary.end());
+    std::printf("%zu items, %zu terms\n\n", corpus.size(), terms.size());
+    std::printf("%-24s %10s %14s %14s %8s\n", "input", "matches", "before [us]", "after [us]", "speedup");
+
+    double totalBefore = 0, totalAfter = 0;
+    for (size_t length = 1; length <= query.size(); ++length) {
+        const vector<QString> keystroke = words(query.substr(0, length));
+        if (keystroke.empty())
+            continue;
+        size_t matchesBefore = 0, matchesAfter = 0;
+        const double before = measure([&](){ return matchBefore(terms, keystroke); }, matchesBefore);
+        const double after = measure([&](){ return matchAfter(terms, keystroke); }, matchesAfter);
+        if (matchesBefore != matchesAfter) {
+            std::fprintf(stderr, "Result mismatch for \"%s\"\n", query.substr(0, length).c_str());
+            return 1;
+        }
+        totalBefore += before;
+        totalAfter += after;
+        std::printf("%-24s %10zu %14.1f %14.1f %7.1fx\n", ("\"" + query.substr(0, length) + "\"").c_str(),
+                    matchesAfter, before, after, before / after);
+    }
+    std::printf("%-24s %10s %14.1f %14.1f %7.1fx\n", "total", "", totalBefore, totalAfter, totalBefore / totalAfter);
+    return 0;
+}
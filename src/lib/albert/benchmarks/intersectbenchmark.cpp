@@ -0,0 +1,230 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/*
+ * Replays the keystrokes of a query against the terms of a corpus and prints
+ * the time the posting lists of PrefixSearch::search take per keystroke,
+ * before (std::set unions and intersections) and after (sorted vectors,
+ * rarest word first, galloping or vectorized merges).
+ *
+ * Usage: intersectbenchmark [corpus [query]]
+ * The corpus has an item per line, e.g. the output of `find ~`. Without a
+ * corpus 400000 synthetic paths are used. The query defaults to "pro rep 17".
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "postinglist.h"
+using std::map;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+using Core::PostingList;
+
+namespace {
+
+const int REPETITIONS = 5;
+
+// The terms and their posting lists, sorted by term
+typedef vector<pair<string, PostingList>> Dictionary;
+typedef Dictionary::const_iterator TermIterator;
+
+// Lowercase alphanumeric runs, like the tokenizer for ASCII input
+vector<string> words(const string &text) {
+    vector<string> result;
+    string word;
+    for (char c : text) {
+        if (std::isalnum(static_cast<unsigned char>(c)))
+            word.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        else if (!word.empty()) {
+            result.push_back(word);
+            word.clear();
+        }
+    }
+    if (!word.empty())
+        result.push_back(word);
+    return result;
+}
+
+vector<string> syntheticCorpus(size_t size) {
+    const vector<string> names = {
+        "home", "user", "documents", "projects", "project", "report", "reports",
+        "repository", "src", "build", "photos", "music", "programs", "profile",
+        "draft", "invoice", "notes", "presentation", "release", "review"
+    };
+    const vector<string> extensions = { "txt", "pdf", "cpp", "h", "jpg", "md", "odt" };
+    std::mt19937 random(42);
+    std::uniform_int_distribution<size_t> name(0, names.size() - 1);
+    std::uniform_int_distribution<size_t> extension(0, extensions.size() - 1);
+    std::uniform_int_distribution<int> depth(2, 6);
+    std::uniform_int_distribution<int> number(0, 9999);
+
+    vector<string> corpus;
+    corpus.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        string path;
+        for (int d = depth(random); d > 0; --d)
+            path += "/" + names[name(random)];
+        path += "/" + names[name(random)] + "_" + std::to_string(number(random))
+                + "." + extensions[extension(random)];
+        corpus.push_back(path);
+    }
+    return corpus;
+}
+
+Dictionary buildDictionary(const vector<string> &corpus) {
+    map<string, PostingList> terms;
+    for (uint32_t id = 0; id < corpus.size(); ++id)
+        for (const string &word : words(corpus[id])) {
+            PostingList &postings = terms[word];
+            if (postings.empty() || postings.back() != id)
+                postings.push_back(id);
+        }
+    return Dictionary(terms.begin(), terms.end());
+}
+
+// The range of terms starting with prefix
+pair<TermIterator, TermIterator> prefixRange(const Dictionary &dictionary, const string &prefix) {
+    TermIterator first = std::lower_bound(
+                dictionary.begin(), dictionary.end(), prefix,
+                [](const Dictionary::value_type &term, const string &p){ return term.first < p; });
+    TermIterator last = first;
+    while (last != dictionary.end() && last->first.compare(0, prefix.size(), prefix) == 0)
+        ++last;
+    return std::make_pair(first, last);
+}
+
+// Unites and intersects std::sets, like PrefixSearch::search did before
+size_t searchBefore(const Dictionary &dictionary, const vector<string> &query) {
+    set<uint32_t> results;
+    for (vector<string>::const_iterator it = query.begin(); it != query.end(); ++it) {
+        set<uint32_t> wordMappingsUnion;
+        pair<TermIterator, TermIterator> range = prefixRange(dictionary, *it);
+        for (TermIterator term = range.first; term != range.second; ++term)
+            wordMappingsUnion.insert(term->second.begin(), term->second.end());
+        if (it == query.begin())
+            results = std::move(wordMappingsUnion);
+        else {
+            set<uint32_t> intersection;
+            std::set_intersection(results.begin(), results.end(),
+                                  wordMappingsUnion.begin(), wordMappingsUnion.end(),
+                                  std::inserter(intersection, intersection.begin()));
+            results = std::move(intersection);
+        }
+    }
+    return results.size();
+}
+
+// Unites and intersects posting lists, like PrefixSearch::search does now
+size_t searchAfter(const Dictionary &dictionary, const vector<string> &query, uint32_t universe) {
+    struct WordRange { pair<TermIterator, TermIterator> terms; size_t estimate; };
+    vector<WordRange> ranges;
+    for (const string &word : query) {
+        WordRange r;
+        r.terms = prefixRange(dictionary, word);
+        r.estimate = 0;
+        for (TermIterator term = r.terms.first; term != r.terms.second; ++term)
+            r.estimate += term->second.size();
+        ranges.push_back(r);
+    }
+    std::sort(ranges.begin(), ranges.end(),
+              [](const WordRange &lhs, const WordRange &rhs){ return lhs.estimate < rhs.estimate; });
+
+    PostingList results, wordMappingsUnion, intersection;
+    for (vector<WordRange>::const_iterator it = ranges.cbegin(); it != ranges.cend(); ++it) {
+        PostingList &target = (it == ranges.cbegin()) ? results : wordMappingsUnion;
+        target.clear();
+        target.reserve(it->estimate);
+        for (TermIterator term = it->terms.first; term != it->terms.second; ++term)
+            target.insert(target.end(), term->second.begin(), term->second.end());
+        Core::makePostingList(target, universe);
+        if (it != ranges.cbegin()) {
+            Core::intersect(results, wordMappingsUnion, intersection);
+            results.swap(intersection);
+        }
+        if (results.empty())
+            break;
+    }
+    return results.size();
+}
+
+// The mean runtime of function in microseconds
+template <typename Function>
+double measure(Function function, size_t &matches) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < REPETITIONS; ++i)
+        matches = function();
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / REPETITIONS;
+}
+
+}
+
+
+
+int main(int argc, char **argv) {
+
+    vector<string> corpus;
+    if (argc > 1) {
+        std::ifstream file(argv[1]);
+        if (!file) {
+            std::fprintf(stderr, "Could not open %s\n", argv[1]);
+            return 1;
+        }
+        string line;
+        while (std::getline(file, line))
+            corpus.push_back(line);
+    } else
+        corpus = syntheticCorpus(400000);
+    const string query = (argc > 2) ? argv[2] : "pro rep 17";
+
+    const Dictionary dictionary = buildDictionary(corpus);
+    const uint32_t universe = static_cast<uint32_t>(corpus.size());
+    std::printf("%zu items, %zu terms\n\n", corpus.size(), dictionary.size());
+    std::printf("%-24s %10s %14s %14s %8s\n", "input", "matches", "before [us]", "after [us]", "speedup");
+
+    double totalBefore = 0, totalAfter = 0;
+    for (size_t length = 1; length <= query.size(); ++length) {
+        const vector<string> keystroke = words(query.substr(0, length));
+        if (keystroke.empty())
+            continue;
+        size_t matchesBefore = 0, matchesAfter = 0;
+        const double before = measure([&](){ return searchBefore(dictionary, keystroke); }, matchesBefore);
+        const double after = measure([&](){ return searchAfter(dictionary, keystroke, universe); }, matchesAfter);
+        if (matchesBefore != matchesAfter) {
+            std::fprintf(stderr, "Result mismatch for \"%s\"\n", query.substr(0, length).c_str());
+            return 1;
+        }
+        totalBefore += before;
+        totalAfter += after;
+        std::printf("%-24s %10zu %14.1f %14.1f %7.1fx\n", ("\"" + query.substr(0, length) + "\"").c_str(),
+                    matchesAfter, before, after, before / after);
+    }
+    std::printf("%-24s %10s %14.1f %14.1f %7.1fx\n", "total", "", totalBefore, totalAfter, totalBefore / totalAfter);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/*
+ * Replays the usages of the core database in the order they happened and
+ * prints the mean rank of the chosen item among the items used before, before
+ * (ordered by usage score only) and after (ordered by the usages for the
+ * prefix of the input first, see MatchCompare). The scores are updated after
+ * every usage, like the DatabaseWorker does.
+ *
+ * Usage: usagereplay database
+ * The database is core.db in the cache directory of albert, usually
+ * ~/.cache/albert/core.db. It is opened read only.
+ */
+
+#include <QHash>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+#include <QVariant>
+#include <cstdio>
+#include <vector>
+#include "item.h"
+#include "matchcompare.h"
+using Core::MatchCompare;
+using std::vector;
+
+namespace {
+
+// MatchCompare needs the id and the urgency of an item only
+class UsedItem final : public Core::Item
+{
+public:
+    explicit UsedItem(const QString &id) : id_(id) { }
+    QString id() const override { return id_; }
+    QString iconPath() const override { return QString(); }
+    QString text() const override { return id_; }
+    QString subtext() const override { return QString(); }
+    vector<std::shared_ptr<Core::Action>> actions() override { return vector<std::shared_ptr<Core::Action>>(); }
+private:
+    QString id_;
+};
+
+// The rank of the chosen item among the items, one is best
+size_t rank(const MatchCompare &compare, const vector<UsedItem> &items, const QString &chosenId) {
+    const uint64_t chosenKey = compare.key(UsedItem(chosenId), 0);
+    size_t rank = 1;
+    for (const UsedItem &item : items)
+        if (compare.key(item, 0) > chosenKey)
+            ++rank;
+    return rank;
+}
+
+}
+
+
+int main(int argc, char **argv) {
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s database\n", argv[0]);
+        return 1;
+    }
+
+    QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE");
+    database.setDatabaseName(QString::fromLocal8Bit(argv[1]));
+    database.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!database.open()) {
+        fprintf(stderr, "Unable to open %s: %s\n", argv[1], database.lastError().text().toUtf8().constData());
+        return 1;
+    }
+
+    QSqlQuery query;
+    if (!query.exec("SELECT input, itemId, julianday(timestamp) FROM usages "
+                    "WHERE itemId<>'' AND input<>'' ORDER BY timestamp;")) {
+        fprintf(stderr, "Unable to read the usages: %s\n", query.lastError().text().toUtf8().constData());
+        return 1;
+    }
+
+    // Start from scratch, the scores evolve with the replay
+    MatchCompare::clearScores();
+    QHash<QString, MatchCompare::UsageScore> scores;
+    vector<UsedItem> items;
+    size_t usages = 0, ranked = 0, rankSumBefore = 0, rankSumAfter = 0;
+
+    while (query.next()) {
+        const MatchCompare::InputUsage usage{query.value(0).toString(), query.value(1).toString(), query.value(2).toDouble()};
+        ++usages;
+
+        // Items used for the first time have no rank yet
+        QHash<QString, MatchCompare::UsageScore>::iterator score = scores.find(usage.itemId);
+        if (score != scores.end()) {
+            rankSumBefore += rank(MatchCompare(), items, usage.itemId);
+            rankSumAfter += rank(MatchCompare(usage.input), items, usage.itemId);
+            ++ranked;
+            *score = MatchCompare::addUsage(*score, usage.time);
+        } else {
+            score = scores.insert(usage.itemId, {1, usage.time});
+            items.emplace_back(usage.itemId);
+        }
+
+        MatchCompare::updateScores({{usage.itemId, *score}});
+        MatchCompare::addInputUsages({usage});
+    }
+
+    printf("%zu usages of %zu items, %zu ranked\n", usages, items.size(), ranked);
+    if (ranked == 0)
+        return 0;
+    printf("mean rank before (usage score)     %.3f\n", static_cast<double>(rankSumBefore) / ranked);
+    printf("mean rank after (input preference) %.3f\n", static_cast<double>(rankSumAfter) / ranked);
+    return 0;
+}
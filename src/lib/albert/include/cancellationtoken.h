@@ -0,0 +1,72 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QMutex>
+#include <atomic>
+#include <functional>
+#include <map>
+#include "core_globals.h"
+
+namespace Core {
+
+/** ****************************************************************************
+* @brief Signals that the work on a query is not needed anymore
+* Long running code polls isCanceled or registers callbacks to abort blocking
+* operations, e.g. to kill a process. All members are thread safe.
+*/
+class EXPORT_CORE CancellationToken final
+{
+public:
+
+    CancellationToken();
+    ~CancellationToken();
+
+    /** Whether the token has been canceled. Cheap enough for tight loops. */
+    bool isCanceled() const { return canceled_; }
+
+    /**
+     * @brief Cancels the token
+     * Calls the registered callbacks in the calling thread. Subsequent calls
+     * have no effect.
+     */
+    void cancel();
+
+    /**
+     * @brief Registers a callback called on cancellation
+     * If the token has been canceled already the callback is called
+     * immediately. Callbacks must not (dis)connect callbacks of the token.
+     * @return The id to disconnect the callback
+     */
+    uint connect(std::function<void()> callback) const;
+
+    /**
+     * @brief Unregisters a callback
+     * If the callback is running in another thread this waits until it
+     * returned, hence the data it refers to can be destroyed afterwards.
+     */
+    void disconnect(uint id) const;
+
+private:
+
+    std::atomic<bool> canceled_;
+    mutable QMutex mutex_;
+    mutable std::map<uint,std::function<void()>> callbacks_;
+    mutable uint nextId_;
+
+};
+
+}
@@ -38,6 +38,9 @@ public:
 
     virtual ~Indexable() {}
 
+    /** The identifier used to update and remove the item in the index */
+    virtual QString id() const = 0;
+
     virtual std::vector<WeightedKeyword> indexKeywords() const = 0;
 
 };
@@ -16,18 +16,87 @@
 
 #pragma once
 #include <QString>
-#include <vector>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <utility>
+#include <vector>
 #include "core_globals.h"
 
 namespace Core {
 
-class IndexImpl;
+class CancellationToken;
 class Indexable;
+class OfflineIndexPrivate;
 
 class EXPORT_CORE OfflineIndex final {
 
 public:
+
+    /**
+     * @brief Position in the ranked results of a query
+     *
+     * Pass a default constructed cursor to searchScored to get the first page
+     * of the results. searchScored advances the cursor past the returned
+     * matches, pass it again along with the same query to get the next page.
+     * The members are internal, do not modify them. Modifying the index
+     * invalidates the cursor.
+     */
+    struct Cursor {
+        float score = std::numeric_limits<float>::infinity();
+        uint32_t id = 0;
+        bool atEnd = false;
+    };
+
+    /**
+     * @brief The state of a ranked search to refine the next search from
+     *
+     * Opaque, see refineScored.
+     */
+    class Refinement;
+
+    /**
+     * @brief The way query words match the words of the items
+     *
+     * Prefix: The query word is a prefix of the word.
+     * Fuzzy: The query word is a prefix of the word with some errors, see
+     * setDelta.
+     * Infix: The query word is contained in the word, e.g. "port" matches
+     * "report". Matches at the start of the word rank higher.
+     */
+    enum class SearchMode {
+        Prefix,
+        Fuzzy,
+        Infix
+    };
+
+    /**
+     * @brief The size of an index
+     *
+     * The derived terms are the acronyms and camel case parts of the
+     * keywords. Removed items are not counted, their postings are until the
+     * next compaction.
+     */
+    struct Statistics {
+        uint32_t items = 0;
+        uint32_t terms = 0;
+        uint32_t postings = 0;
+        uint32_t derivedTerms = 0;
+        uint32_t derivedPostings = 0;
+    };
+
+    /**
+     * @brief Creates the item with the given id from the payload it has been
+     * saved with, see load
+     */
+    typedef std::function<std::shared_ptr<Core::Indexable>(const QString &id, const QString &payload)> ItemFactory;
+
+    /**
+     * @brief Returns the payload to save along with an item, see save
+     */
+    typedef std::function<QString(const Core::Indexable &item)> PayloadFunction;
+
     /**
      * @brief Contstructs a search
      * @param fuzzy Sets the type of the search. Defaults to false.
@@ -40,8 +109,30 @@ public:
      */
     ~OfflineIndex();
 
+    OfflineIndex(const OfflineIndex&) = delete;
+    OfflineIndex &operator=(const OfflineIndex&) = delete;
+
+    /**
+     * @brief Sets the search mode
+     *
+     * Returns immediately. The fuzzy and the infix search are overlays of the
+     * index that are built in the background, until the overlay is ready
+     * searches match prefixes.
+     *
+     * @param mode The mode to set
+     */
+    void setSearchMode(SearchMode mode);
+
+    /**
+     * @brief The search mode
+     */
+    SearchMode searchMode() const;
+
     /**
      * @brief Sets the type of the search to fuzzy
+     *
+     * Shorthand for setSearchMode(fuzzy ? Fuzzy : Prefix).
+     *
      * @param fuzzy The type to set. Defaults to true.
      */
     void setFuzzy(bool fuzzy = true);
@@ -57,8 +148,8 @@ public:
      *
      * If the value d is >1, the search tolerates d errors. If the value d is <1,
      * the search tolerates wordlength * d errors. The "amount of tolerance" is
-     * measures in maximal prefix edit distance. If the search is not set to fuzzy
-     * setDelta has no effect.
+     * measures in maximal prefix edit distance. The value takes effect as soon
+     * as the search is set to fuzzy.
      *
      * @param t The amount of error tolerance
      */
@@ -70,25 +161,183 @@ public:
      */
     double delta();
 
+    /**
+     * @brief Sets whether diacritics are folded
+     *
+     * If set, keywords and queries are NFKD normalized and stripped of their
+     * combining marks, i.e. "resume" matches "Résumé" and vice versa. The
+     * words of an index are folded when they are indexed, hence changing the
+     * option clears the index. Like all modifications this is not visible to
+     * searches until the next commit.
+     *
+     * @param fold Whether to fold diacritics. Defaults to true.
+     */
+    void setFoldDiacritics(bool fold = true);
+
+    /**
+     * @brief Whether diacritics are folded
+     * @return True if diacritics are folded else false.
+     */
+    bool foldDiacritics() const;
+
     /**
      * @brief Build the search index
+     *
+     * An item with the same id is replaced, see update. Like all
+     * modifications the item is not visible to searches until the next
+     * commit.
+     *
      * @param The items to index
      */
     void add(std::shared_ptr<Core::Indexable> idxble);
 
+    /**
+     * @brief Add or replace an item
+     *
+     * Replaces the item with the same id or adds it if there is none. If the
+     * index keywords did not change only the item is swapped, otherwise the
+     * old item is removed and the new one is added.
+     *
+     * @param idxble The item to update
+     */
+    void update(std::shared_ptr<Core::Indexable> idxble);
+
+    /**
+     * @brief Replace the items of the index
+     *
+     * Updates the items that are in the index already, see update, adds the
+     * new ones and removes the items that are not in items. Use it to apply
+     * a rescan, items with unchanged keywords keep their postings. Includes
+     * the items of a loaded index file.
+     *
+     * @param items The items the index shall contain
+     */
+    void assign(const std::vector<std::shared_ptr<Core::Indexable>> &items);
+
+    template <typename T>
+    void assign(const std::vector<std::shared_ptr<T>> &items) {
+        assign(std::vector<std::shared_ptr<Core::Indexable>>(items.begin(), items.end()));
+    }
+
+    /**
+     * @brief Remove an item from the index
+     *
+     * The item is marked as removed and skipped by searches. The postings are
+     * dropped by a compaction as soon as enough items have been removed.
+     *
+     * @param id The id of the item to remove
+     */
+    void remove(const QString &id);
+
     /**
      * @brief Clear the search index
      */
     void clear();
 
+    /**
+     * @brief Publish the changes made since the last commit
+     *
+     * Modifications are applied to a private copy of the index, searches use
+     * the last published snapshot. Commit builds the copy and atomically
+     * swaps it in. Running searches finish on the snapshot they started with.
+     * Hence the index can be modified and committed in a worker thread while
+     * other threads search it.
+     */
+    void commit();
+
+    /**
+     * @brief Write the published index to a file
+     *
+     * The versioned binary file holds the dictionary, the postings and a table
+     * of the ids of the items along with a payload string each, i.e. whatever
+     * is needed to recreate an item. The file is replaced atomically.
+     *
+     * @param path The path of the file
+     * @param payload Returns the payload of an item
+     * @return True on success
+     */
+    bool save(const QString &path, const PayloadFunction &payload) const;
+
+    /**
+     * @brief Replace the index by the one saved to a file
+     *
+     * The file is mapped read only and searched in place, there is no
+     * deserialization step. The items are created by the factory when they
+     * are returned by a search for the first time, hence the factory has to
+     * be thread safe. Uncommitted modifications are discarded.
+     *
+     * @param path The path of the file
+     * @param factory Creates an item from its id and payload
+     * @return False if the file is missing, of a different version, corrupt
+     * or saved with a different diacritic folding option. The index is left
+     * unchanged then.
+     */
+    bool load(const QString &path, ItemFactory factory);
+
+    /**
+     * @brief The size of the published index
+     */
+    Statistics statistics() const;
+
     /**
      * @brief Perform a search on the index
      * @param req The query string
+     * @param token If not null the search stops as soon as the token is
+     * canceled and returns nothing
      */
-    std::vector<std::shared_ptr<Core::Indexable>> search(const QString &req) const;
+    std::vector<std::shared_ptr<Core::Indexable>> search(const QString &req,
+                                                         const CancellationToken *token = nullptr) const;
+
+    /**
+     * @brief Perform a ranked search on the index
+     *
+     * The score of a match combines the relevance of the matched keywords, the
+     * quality of the match (exact, prefix or edit distance) and the fraction
+     * of the words of the item covered by the query. Only the best matches are
+     * selected and returned. The search stops scanning postings as soon as
+     * the best limit matches are settled, hence small limits are cheap.
+     *
+     * @param req The query string
+     * @param limit The maximal number of results
+     * @param cursor If not null only matches ranked behind the cursor are
+     * returned and the cursor is advanced past the returned matches
+     * @param token If not null the search stops as soon as the token is
+     * canceled and returns nothing
+     * @return The matches and their scores in [0,SHRT_MAX], best first
+     */
+    std::vector<std::pair<std::shared_ptr<Core::Indexable>,short>> searchScored(const QString &req,
+                                                                                size_t limit = SIZE_MAX,
+                                                                                Cursor *cursor = nullptr,
+                                                                                const CancellationToken *token = nullptr) const;
+
+    /**
+     * @brief Perform a ranked search refining a previous one
+     *
+     * Like searchScored, but reuses the matches of the query words that did
+     * not change since the previous search, e.g. only "bar" is looked up when
+     * "foo ba" becomes "foo bar", and then among the matches of "foo ba" only.
+     * The matches are reused only if the index has not been modified in
+     * between and the search mode is Prefix, otherwise the search starts from
+     * scratch. Unlike searchScored it always collects all matches, hence the
+     * first search of a refinement can take longer.
+     *
+     * @param req The query string
+     * @param limit The maximal number of results
+     * @param refinement The state of the previous search or null. Receives the
+     * state of this search, the previous state is left unchanged.
+     * @param token If not null the search stops as soon as the token is
+     * canceled and returns nothing
+     * @return The matches and their scores in [0,SHRT_MAX], best first
+     */
+    std::vector<std::pair<std::shared_ptr<Core::Indexable>,short>> refineScored(const QString &req,
+                                                                                size_t limit,
+                                                                                std::shared_ptr<Refinement> &refinement,
+                                                                                const CancellationToken *token = nullptr) const;
 
 private:
-    IndexImpl *impl_;
+
+    // Shared with the background tasks building the fuzzy search
+    std::shared_ptr<OfflineIndexPrivate> d;
 };
 
 }
@@ -21,6 +21,7 @@
 #include <vector>
 #include <utility>
 #include <memory>
+#include "cancellationtoken.h"
 #include "core_globals.h"
 #include "queryhandler.h"
 
@@ -57,12 +58,26 @@ public:
 
     bool isValid() const;
 
+    /**
+     * @brief The token canceled when the query gets invalidated
+     * Poll it or register callbacks to abort long running operations. It
+     * lives as long as the query.
+     */
+    const CancellationToken &cancellationToken() const;
+
     void addMatch(std::shared_ptr<Item> item, short score = 0);
     void addMatches(std::vector<std::pair<std::shared_ptr<Item>,short>>::iterator begin,
                     std::vector<std::pair<std::shared_ptr<Item>,short>>::iterator end);
 
     std::map<QString,uint> runtimes();
 
+    /**
+     * @brief Attaches the state to refine the next query from
+     * Only handlers that refine queries call this, see
+     * QueryHandler::refinesQueries. The state is opaque to the core.
+     */
+    void setRefinementState(QueryHandler *handler, std::shared_ptr<void> state);
+
 private:
 
     Query();
@@ -76,6 +91,14 @@ private:
 
     void setFallbacks(const std::vector<std::shared_ptr<Item>> &);
 
+    void setPreviousQuery(Query *);
+
+    /** The time in microseconds it took to show the first result, -1 if none */
+    qint64 timeToFirstResult() const;
+
+    /** The time in microseconds to the last change of the top results, -1 if none */
+    qint64 timeToStableTop() const;
+
     void run();
 
     std::unique_ptr<QueryPrivate> d;
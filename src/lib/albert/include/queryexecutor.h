@@ -0,0 +1,147 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QFuture>
+#include <QFutureInterface>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include "core_globals.h"
+
+namespace Core {
+
+class QueryExecutorPrivate;
+
+/** ****************************************************************************
+* @brief Runs the work of the core and the extensions on a dedicated pool
+* Tasks are queued in lanes. The interactive lane takes the query handlers,
+* the background lane long running work like indexing. Idle workers always
+* pick interactive tasks first. A running task is never interrupted, but no
+* background task starts while interactive tasks are waiting and background
+* tasks never occupy all workers. Hence a long rescan delays a query by one
+* task at most. All members are thread safe.
+*/
+class EXPORT_CORE QueryExecutor final
+{
+public:
+
+    enum class Lane {
+        Interactive,
+        Background
+    };
+
+    /** The state of a lane */
+    struct LaneMetrics {
+        uint queueDepth = 0;    // Tasks waiting
+        uint running = 0;       // Tasks running
+        quint64 started = 0;    // Tasks started since construction
+        double averageWait = 0; // Exponentially smoothed queue wait in ms
+        qint64 maxWait = 0;     // Longest queue wait in ms
+    };
+
+    /**
+     * @brief Constructs the executor
+     * @param threadCount The number of workers, the ideal thread count if 0.
+     * There are at least two workers.
+     */
+    explicit QueryExecutor(int threadCount = 0);
+
+    /**
+     * @brief Destructs the executor
+     * Runs the queued tasks and waits until all tasks finished.
+     */
+    ~QueryExecutor();
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor &operator=(const QueryExecutor&) = delete;
+
+    /**
+     * @brief Queues a task
+     * Tasks of a lane start in the order they have been queued.
+     */
+    void schedule(Lane lane, std::function<void()> task);
+
+    /**
+     * @brief Queues a function
+     * Like QtConcurrent::run, but on the given lane.
+     * @return The future of the result of the function
+     */
+    template <typename Function>
+    auto run(Lane lane, Function function) -> QFuture<decltype(function())> {
+        typedef decltype(function()) T;
+        QFutureInterface<T> futureInterface(QFutureInterfaceBase::Started);
+        schedule(lane, [futureInterface, function]() mutable {
+            report(futureInterface, function);
+            futureInterface.reportFinished();
+        });
+        return futureInterface.future();
+    }
+
+    /**
+     * @brief Queues the function for each item of a sequence
+     * Like QtConcurrent::map, but on the given lane. The items are passed
+     * by value.
+     * @return The future that finishes when all calls returned
+     */
+    template <typename Iterator, typename Function>
+    QFuture<void> map(Lane lane, Iterator begin, Iterator end, Function function) {
+        QFutureInterface<void> futureInterface(QFutureInterfaceBase::Started);
+        QFuture<void> future = futureInterface.future();
+        if (begin == end) {
+            futureInterface.reportFinished();
+            return future;
+        }
+        std::shared_ptr<std::atomic<int>> remaining
+                = std::make_shared<std::atomic<int>>(static_cast<int>(std::distance(begin, end)));
+        for (Iterator it = begin; it != end; ++it) {
+            auto item = *it;
+            schedule(lane, [futureInterface, remaining, function, item]() mutable {
+                function(item);
+                if (--*remaining == 0)
+                    futureInterface.reportFinished();
+            });
+        }
+        return future;
+    }
+
+    /** The current state of a lane */
+    LaneMetrics metrics(Lane lane) const;
+
+    /** The number of workers */
+    int threadCount() const;
+
+    static QueryExecutor *instance;
+
+private:
+
+    template <typename T, typename Function>
+    static void report(QFutureInterface<T> &futureInterface, Function &function) {
+        const T result = function();
+        futureInterface.reportResult(result);
+    }
+
+    template <typename Function>
+    static void report(QFutureInterface<void> &, Function &function) {
+        function();
+    }
+
+    std::unique_ptr<QueryExecutorPrivate> d;
+
+};
+
+}
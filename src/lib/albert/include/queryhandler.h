@@ -16,6 +16,7 @@
 
 #pragma once
 #include <QString>
+#include <memory>
 #include "core_globals.h"
 
 namespace Core {
@@ -72,6 +73,32 @@ public:
      */
     virtual void handleQuery(Query *query) = 0;
 
+    /**
+     * @brief Whether the handler refines queries incrementally
+     * If true the handler may attach a state to a query, see
+     * Query::setRefinementState, which is passed to handleRefinement when the
+     * next search term extends the search term of the query, e.g. "foo" and
+     * "foob". The state of a query is passed on only if the handler finished
+     * before the query got invalidated, i.e. if it describes a complete
+     * answer.
+     */
+    virtual bool refinesQueries() const { return false; }
+
+    /**
+     * @brief Incremental query handling
+     * Called instead of handleQuery if the handler refines queries and
+     * attached a state to the previous query. The matches of a prefix-style
+     * handler for an extended search term are a subset of the previous ones,
+     * hence the handler can narrow down its previous candidates instead of
+     * searching from scratch. The same rules as for handleQuery apply.
+     * @param query Holds the query context
+     * @param state The state the handler attached to the previous query
+     */
+    virtual void handleRefinement(Query *query, std::shared_ptr<void> state) {
+        Q_UNUSED(state)
+        handleQuery(query);
+    }
+
 };
 
 }
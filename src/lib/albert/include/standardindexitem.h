@@ -33,6 +33,8 @@ public:
 
     StandardIndexItem(const QString &id);
 
+    QString id() const override;
+
     virtual std::vector<Core::Indexable::WeightedKeyword> indexKeywords() const override;
     virtual void setIndexKeywords(std::vector<Indexable::WeightedKeyword> &&indexKeywords);
 
@@ -36,7 +36,7 @@ public:
 
     StandardItem(const QString &id = QString());
 
-    QString id() const override final;
+    QString id() const override;
 
     QString text() const override;
     void setText(const QString &text);
@@ -21,8 +21,6 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QSettings>
-#include <QSqlDatabase>
-#include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QStandardPaths>
@@ -30,10 +28,14 @@
 #include <QtNetwork/QLocalSocket>
 #include <csignal>
 #include "albert.h"
+#include "databaseworker.h"
 #include "extensionmanager.h"
 #include "hotkeymanager.h"
 #include "mainwindow.h"
+#include "matchcompare.h"
+#include "queryexecutor.h"
 #include "querymanager.h"
+#include "queryprofiler.h"
 #include "settingswidget.h"
 #include "trayicon.h"
 #include "xdgiconlookup.h"
@@ -46,6 +48,7 @@ static void dispatchMessage();
 
 static QApplication           *app;
 static QueryManager           *queryManager;
+static QueryProfiler          *queryProfiler;
 static MainWindow             *mainWindow;
 static HotkeyManager          *hotkeyManager;
 static SettingsWidget         *settingsWidget;
@@ -187,55 +190,64 @@ int Albert::run(int argc, char **argv) {
          * INITIALIZE DATABASE
          */
 
-        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
-        if ( !db.isValid() )
-            qFatal("No sqlite available");
-
-        if (!db.driver()->hasFeature(QSqlDriver::Transactions))
-            qFatal("QSqlDriver::Transactions not available.");
-
-        db.setDatabaseName(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("core.db"));
-        if (!db.open())
-            qFatal("Unable to establish a database connection.");
-
-        db.transaction();
-
-        // Create tables
-        QSqlQuery q;
-        if (!q.exec("CREATE TABLE IF NOT EXISTS usages ( "
-                    "  input TEXT NOT NULL, "
-                    "  itemId TEXT, "
-                    "  timestamp DATETIME DEFAULT CURRENT_TIMESTAMP "
-                    ");"))
-            qFatal("Unable to create table 'usages': %s", q.lastError().text().toUtf8().constData());
-
-        if (!q.exec("CREATE TABLE IF NOT EXISTS runtimes ( "
-                    "  extensionId TEXT NOT NULL, "
-                    "  runtime INTEGER NOT NULL, "
-                    "  timestamp DATETIME DEFAULT CURRENT_TIMESTAMP "
-                    ");"))
-            qFatal("Unable to create table 'runtimes': %s", q.lastError().text().toUtf8().constData());
-
-        // Do regular cleanup
-        if (!q.exec("DELETE FROM usages WHERE julianday('now')-julianday(timestamp)>90;"))
-            qWarning("Unable to cleanup usages table.");
-
-        if (!q.exec("DELETE FROM runtimes WHERE julianday('now')-julianday(timestamp)>7;"))
-            qWarning("Unable to cleanup runtimes table.");
-
-        db.commit();
+        // All access to the database runs in the worker, the setup and the
+        // cleanup do not delay the first paint
+        DatabaseWorker::instance = new DatabaseWorker(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("core.db"));
+        DatabaseWorker::instance->execute([](){
+
+            // Create tables
+            QSqlQuery q;
+            if (!q.exec("CREATE TABLE IF NOT EXISTS usages ( "
+                        "  input TEXT NOT NULL, "
+                        "  itemId TEXT, "
+                        "  timestamp DATETIME DEFAULT CURRENT_TIMESTAMP "
+                        ");"))
+                qFatal("Unable to create table 'usages': %s", q.lastError().text().toUtf8().constData());
+
+            if (!q.exec("CREATE TABLE IF NOT EXISTS runtimes ( "
+                        "  extensionId TEXT NOT NULL, "
+                        "  runtime INTEGER NOT NULL, "
+                        "  timestamp DATETIME DEFAULT CURRENT_TIMESTAMP "
+                        ");"))
+                qFatal("Unable to create table 'runtimes': %s", q.lastError().text().toUtf8().constData());
+
+            if (!q.exec("CREATE TABLE IF NOT EXISTS usage_scores ( "
+                        "  itemId TEXT PRIMARY KEY, "
+                        "  score REAL NOT NULL, "
+                        "  timestamp REAL NOT NULL "
+                        ");"))
+                qFatal("Unable to create table 'usage_scores': %s", q.lastError().text().toUtf8().constData());
+
+            // Do regular cleanup
+            if (!q.exec("DELETE FROM usages WHERE julianday('now')-julianday(timestamp)>90;"))
+                qWarning("Unable to cleanup usages table.");
+
+            if (!q.exec("DELETE FROM runtimes WHERE julianday('now')-julianday(timestamp)>7;"))
+                qWarning("Unable to cleanup runtimes table.");
+
+            if (!q.exec("DELETE FROM usage_scores WHERE julianday('now')-timestamp>90;"))
+                qWarning("Unable to cleanup usage_scores table.");
+
+            // The scores are maintained incrementally, derive them once from
+            // the usages of older versions
+            if (q.exec("SELECT EXISTS (SELECT 1 FROM usage_scores), EXISTS (SELECT 1 FROM usages WHERE itemId<>'');")
+                    && q.next() && !q.value(0).toBool() && q.value(1).toBool())
+                Core::MatchCompare::rebuildScores();
+        });
 
 
         /*
          *  INITIALIZE APPLICATION COMPONENTS
          */
 
+        Core::QueryExecutor::instance = new Core::QueryExecutor;
         ExtensionManager::instance = new Core::ExtensionManager;
         trayIcon         = new TrayIcon;
         trayIconMenu     = new QMenu;
         hotkeyManager    = new HotkeyManager;
         mainWindow       = new MainWindow;
-        queryManager     = new QueryManager(ExtensionManager::instance);
+        queryProfiler    = new QueryProfiler;
+        queryManager     = new QueryManager(ExtensionManager::instance, queryProfiler);
         localServer      = new QLocalServer;
 
 
@@ -341,7 +353,7 @@ int Albert::run(int argc, char **argv) {
         Core::ExtensionManager::instance->reloadExtensions();
 
         // Application is initialized create the settings widget
-        settingsWidget = new SettingsWidget(mainWindow, hotkeyManager, ExtensionManager::instance, trayIcon);
+        settingsWidget = new SettingsWidget(mainWindow, hotkeyManager, ExtensionManager::instance, trayIcon, queryProfiler);
 
         // If somebody requested the settings dialog open it
         if ( showSettingsWhenInitialized )
@@ -409,9 +421,12 @@ int Albert::run(int argc, char **argv) {
     delete trayIconMenu;
     delete trayIcon;
     delete queryManager;
+    delete queryProfiler;
+    delete DatabaseWorker::instance;
     delete hotkeyManager;
     delete mainWindow;
     delete ExtensionManager::instance;
+    delete Core::QueryExecutor::instance;
 
     localServer->close();
 
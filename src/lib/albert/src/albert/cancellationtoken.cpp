@@ -0,0 +1,65 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "cancellationtoken.h"
+using std::function;
+
+
+/** ***************************************************************************/
+Core::CancellationToken::CancellationToken() : canceled_(false), nextId_(1) {
+
+}
+
+
+/** ***************************************************************************/
+Core::CancellationToken::~CancellationToken() {
+
+}
+
+
+/** ***************************************************************************/
+void Core::CancellationToken::cancel() {
+    QMutexLocker lock(&mutex_);
+    if (canceled_)
+        return;
+    canceled_ = true;
+
+    // Called locked, disconnect waits for running callbacks this way
+    for (const std::pair<const uint,function<void()>> &callback : callbacks_)
+        callback.second();
+    callbacks_.clear();
+}
+
+
+/** ***************************************************************************/
+uint Core::CancellationToken::connect(function<void()> callback) const {
+    {
+        QMutexLocker lock(&mutex_);
+        if (!canceled_) {
+            callbacks_.emplace(nextId_, std::move(callback));
+            return nextId_++;
+        }
+    }
+    callback();
+    return 0;
+}
+
+
+/** ***************************************************************************/
+void Core::CancellationToken::disconnect(uint id) const {
+    QMutexLocker lock(&mutex_);
+    callbacks_.erase(id);
+}
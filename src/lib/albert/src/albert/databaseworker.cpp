@@ -0,0 +1,253 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QDateTime>
+#include <QDebug>
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QSqlError>
+#include "databaseworker.h"
+#include "matchcompare.h"
+using Core::MatchCompare;
+using std::function;
+using std::pair;
+using std::vector;
+
+namespace {
+
+// The time in milliseconds without new usages after which they are written
+const qint64 IDLE_DELAY = 2000;
+
+// The number of buffered usages that are written without delay
+const size_t BUFFER_CAPACITY = 256;
+
+}
+
+/** ***************************************************************************/
+DatabaseWorker *DatabaseWorker::instance = nullptr;
+
+
+
+/** ***************************************************************************/
+DatabaseWorker::DatabaseWorker(const QString &databaseName)
+    : databaseName_(databaseName),
+      flushRequested_(false),
+      clearRequested_(false),
+      stopRequested_(false) {
+    start(QThread::LowPriority);
+}
+
+
+
+/** ***************************************************************************/
+DatabaseWorker::~DatabaseWorker() {
+    {
+        QMutexLocker lock(&mutex_);
+        stopRequested_ = true;
+        condition_.wakeOne();
+    }
+    wait();
+}
+
+
+
+/** ***************************************************************************/
+void DatabaseWorker::execute(function<void()> task) {
+    QMutexLocker lock(&mutex_);
+    tasks_.push_back(std::move(task));
+    condition_.wakeOne();
+}
+
+
+
+/** ***************************************************************************/
+QSqlQuery &DatabaseWorker::statement(const QString &sql) {
+    // The values of a QHash stay in place when it grows
+    QHash<QString, QSqlQuery>::iterator it = statements_.find(sql);
+    if (it == statements_.end()) {
+        it = statements_.insert(sql, QSqlQuery());
+        if (!it->prepare(sql))
+            qWarning() << it->lastError();
+    }
+    return *it;
+}
+
+
+
+/** ***************************************************************************/
+void DatabaseWorker::addUsage(const QString &input, const QString &itemId) {
+    // The format of CURRENT_TIMESTAMP, the default of the column, and the
+    // julian day like julianday() of sqlite
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    const QString timestamp = now.toString("yyyy-MM-dd hh:mm:ss");
+    const double time = now.date().toJulianDay() - 0.5 + now.time().msecsSinceStartOfDay() / 86400000.0;
+    QMutexLocker lock(&mutex_);
+    usages_.push_back({input, itemId, timestamp, time});
+    lastUsage_.start();
+    if (usages_.size() >= BUFFER_CAPACITY)
+        condition_.wakeOne();
+}
+
+
+
+/** ***************************************************************************/
+void DatabaseWorker::flush() {
+    QMutexLocker lock(&mutex_);
+    flushRequested_ = true;
+    condition_.wakeOne();
+}
+
+
+
+/** ***************************************************************************/
+void DatabaseWorker::clear() {
+    QMutexLocker lock(&mutex_);
+    usages_.clear();
+    clearRequested_ = true;
+    condition_.wakeOne();
+}
+
+
+
+/** ***************************************************************************/
+void DatabaseWorker::run() {
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+        if ( !db.isValid() )
+            qFatal("No sqlite available");
+
+        if (!db.driver()->hasFeature(QSqlDriver::Transactions))
+            qFatal("QSqlDriver::Transactions not available.");
+
+        db.setDatabaseName(databaseName_);
+        if (!db.open())
+            qFatal("Unable to establish a database connection.");
+
+        // The write ahead log is persistent, a commit appends to it instead
+        // of rewriting the database. Syncing at checkpoints only keeps the
+        // database consistent, commits survive a crash of the process.
+        QSqlQuery query;
+        if (!query.exec("PRAGMA journal_mode=WAL;") || !query.exec("PRAGMA synchronous=NORMAL;"))
+            qWarning() << query.lastError();
+
+        QMutexLocker lock(&mutex_);
+        forever {
+
+            // Wait for tasks, a request, a full buffer or the buffer to
+            // become idle
+            while (tasks_.empty() && !flushRequested_ && !clearRequested_ && !stopRequested_
+                   && usages_.size() < BUFFER_CAPACITY) {
+                if (usages_.empty())
+                    condition_.wait(&mutex_);
+                else {
+                    const qint64 remaining = IDLE_DELAY - lastUsage_.elapsed();
+                    if (remaining <= 0)
+                        break;
+                    condition_.wait(&mutex_, static_cast<unsigned long>(remaining));
+                }
+            }
+
+            vector<function<void()>> tasks;
+            tasks.swap(tasks_);
+            vector<Usage> usages;
+            usages.swap(usages_);
+            const bool clear = clearRequested_;
+            const bool stop = stopRequested_;
+            clearRequested_ = false;
+            flushRequested_ = false;
+            lock.unlock();
+
+            // Run the batch in one transaction
+            db.transaction();
+            if (clear && (!query.exec("DELETE FROM usages;") || !query.exec("DELETE FROM usage_scores;")))
+                qWarning() << query.lastError();
+            QHash<QString, MatchCompare::UsageScore> scores;
+            if (!usages.empty()) {
+                QSqlQuery &insertUsage = statement("INSERT INTO usages (input, itemId, timestamp) VALUES (:input, :itemId, :timestamp);");
+                for (const Usage &usage : usages) {
+                    insertUsage.bindValue(":input", usage.input);
+                    insertUsage.bindValue(":itemId", usage.itemId);
+                    insertUsage.bindValue(":timestamp", usage.timestamp);
+                    if (!insertUsage.exec())
+                        qWarning() << insertUsage.lastError();
+                }
+
+                // Add the usages to the scores of the items
+                QSqlQuery &selectScore = statement("SELECT score, timestamp FROM usage_scores WHERE itemId=:itemId;");
+                for (const Usage &usage : usages) {
+                    if (usage.itemId.isEmpty())
+                        continue;
+                    QHash<QString, MatchCompare::UsageScore>::iterator it = scores.find(usage.itemId);
+                    if (it == scores.end()) {
+                        selectScore.bindValue(":itemId", usage.itemId);
+                        if (selectScore.exec() && selectScore.next())
+                            it = scores.insert(usage.itemId, {selectScore.value(0).toDouble(), selectScore.value(1).toDouble()});
+                        else {
+                            scores.insert(usage.itemId, {1, usage.time});
+                            continue;
+                        }
+                        selectScore.finish();
+                    }
+                    *it = MatchCompare::addUsage(*it, usage.time);
+                }
+                QSqlQuery &replaceScore = statement("INSERT OR REPLACE INTO usage_scores (itemId, score, timestamp) VALUES (:itemId, :score, :timestamp);");
+                for (QHash<QString, MatchCompare::UsageScore>::const_iterator it = scores.cbegin(); it != scores.cend(); ++it) {
+                    replaceScore.bindValue(":itemId", it.key());
+                    replaceScore.bindValue(":score", it->score);
+                    replaceScore.bindValue(":timestamp", it->time);
+                    if (!replaceScore.exec())
+                        qWarning() << replaceScore.lastError();
+                }
+            }
+            for (function<void()> &task : tasks) {
+                task();
+                // Release the captures before the next task
+                task = nullptr;
+            }
+            if (!db.commit())
+                qWarning() << db.lastError();
+
+            // Publish the new scores
+            if (clear)
+                MatchCompare::clearScores();
+            if (!scores.isEmpty()) {
+                vector<MatchCompare::InputUsage> inputUsages;
+                inputUsages.reserve(usages.size());
+                for (const Usage &usage : usages)
+                    if (!usage.itemId.isEmpty() && !usage.input.isEmpty())
+                        inputUsages.push_back({usage.input, usage.itemId, usage.time});
+                MatchCompare::addInputUsages(inputUsages);
+
+                vector<pair<QString, MatchCompare::UsageScore>> changes;
+                changes.reserve(static_cast<size_t>(scores.size()));
+                for (QHash<QString, MatchCompare::UsageScore>::const_iterator it = scores.cbegin(); it != scores.cend(); ++it)
+                    changes.emplace_back(it.key(), it.value());
+                MatchCompare::updateScores(changes);
+            }
+
+            if (stop)
+                break;
+
+            lock.relock();
+        }
+
+        // Statements must not outlive the connection
+        statements_.clear();
+    }
+
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
@@ -0,0 +1,133 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QHash>
+#include <QMutex>
+#include <QSqlQuery>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Owns the connection to the core database
+ * All access to core.db runs in the worker thread, which holds the default
+ * connection. Tasks run in the order they have been queued, the tasks queued
+ * while the worker was busy run in one transaction.
+ *
+ * Activations only append their usage to an in-memory buffer. The worker
+ * inserts the buffered usages when no usage has been added for a while, when
+ * the buffer is full, on request, with the next batch of tasks and on
+ * destruction. The usage scores of the items are updated in the same
+ * transaction and passed to MatchCompare.
+ */
+class DatabaseWorker final : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * @brief Opens the database and starts the worker thread
+     * @param databaseName The path of the database
+     */
+    explicit DatabaseWorker(const QString &databaseName);
+
+    /** Runs the queued tasks, writes the buffered usages and stops the thread */
+    ~DatabaseWorker();
+
+    /**
+     * @brief Queues a task
+     * The task runs in the worker thread and may use the default connection
+     * and statement(). It must not begin or end transactions.
+     */
+    void execute(std::function<void()> task);
+
+    /**
+     * @brief Queues a function
+     * Like execute, but the result is returned by the future.
+     */
+    template <typename Function>
+    auto request(Function function) -> QFuture<decltype(function())> {
+        typedef decltype(function()) T;
+        QFutureInterface<T> futureInterface(QFutureInterfaceBase::Started);
+        execute([futureInterface, function]() mutable {
+            report(futureInterface, function);
+            futureInterface.reportFinished();
+        });
+        return futureInterface.future();
+    }
+
+    /**
+     * @brief A prepared statement
+     * The statements are prepared once and reused. Only valid in tasks.
+     */
+    QSqlQuery &statement(const QString &sql);
+
+    /** Buffers a usage, thread safe and cheap */
+    void addUsage(const QString &input, const QString &itemId);
+
+    /** Writes the buffered usages as soon as possible */
+    void flush();
+
+    /** Discards the buffered usages and deletes all usages */
+    void clear();
+
+    static DatabaseWorker *instance;
+
+private:
+
+    struct Usage {
+        QString input;
+        QString itemId;
+        QString timestamp;
+        double time; // Julian day
+    };
+
+    void run() override;
+
+    template <typename T, typename Function>
+    static void report(QFutureInterface<T> &futureInterface, Function &function) {
+        const T result = function();
+        futureInterface.reportResult(result);
+    }
+
+    template <typename Function>
+    static void report(QFutureInterface<void> &, Function &function) {
+        function();
+    }
+
+    const QString databaseName_;
+
+    // The prepared statements by their sql, used by the worker only
+    QHash<QString, QSqlQuery> statements_;
+
+    // Guards the members below
+    QMutex mutex_;
+    QWaitCondition condition_;
+    std::vector<std::function<void()>> tasks_;
+    std::vector<Usage> usages_;
+    QElapsedTimer lastUsage_;
+    bool flushRequested_;
+    bool clearRequested_;
+    bool stopRequested_;
+
+};
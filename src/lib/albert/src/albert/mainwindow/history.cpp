@@ -18,11 +18,13 @@
 #include <QSqlRecord>
 #include <QStringList>
 #include <QVariant>
+#include "databaseworker.h"
 #include "history.h"
 
 
 History::History(QObject *parent) : QObject(parent) {
     currentLine_ = -1; // This means historymode is not active
+    updateHistory();
 }
 
 
@@ -32,13 +34,15 @@ void History::add(QString str) {
         if (lines_.contains(str))
             lines_.removeAll(str); // Remove dups
         lines_.prepend(str);
+        recentLines_.removeAll(str);
+        recentLines_.prepend(str);
     }
 }
 
 
 /** ***************************************************************************/
 QString History::next() {
-    // Update the history at the beginnig
+    // Update the history at the beginnig, the lines requested before are used
     if (currentLine_ == -1)
         updateHistory();
 
@@ -67,10 +71,27 @@ void History::resetIterator() {
 
 /** ***************************************************************************/
 void History::updateHistory() {
-    lines_.clear();
-    QSqlQuery query;
-    query.exec("SELECT input FROM usages GROUP BY input ORDER BY max(timestamp) DESC");
-    while (query.next())
-        lines_.append(query.value(0).toString());
+    if (storedLines_.isRunning())
+        return;
+
+    // Take the loaded lines, the added ones may not be stored yet
+    if (storedLines_.future().resultCount() > 0) {
+        lines_ = storedLines_.result();
+        for (QStringList::const_reverse_iterator it = recentLines_.crbegin(); it != recentLines_.crend(); ++it) {
+            lines_.removeAll(*it);
+            lines_.prepend(*it);
+        }
+    }
+
+    // Load the lines for the next time
+    recentLines_.clear();
+    storedLines_.setFuture(DatabaseWorker::instance->request([](){
+        QStringList lines;
+        QSqlQuery query;
+        query.exec("SELECT input FROM usages GROUP BY input ORDER BY max(timestamp) DESC");
+        while (query.next())
+            lines.append(query.value(0).toString());
+        return lines;
+    }));
 }
 
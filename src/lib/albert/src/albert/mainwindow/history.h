@@ -15,6 +15,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
+#include <QFutureWatcher>
 #include <QObject>
 #include <QStringList>
 
@@ -38,5 +39,10 @@ private:
     QStringList lines_;
     int currentLine_;
 
+    // The stored inputs, loaded in the background, and the lines added
+    // since they have been requested
+    QFutureWatcher<QStringList> storedLines_;
+    QStringList recentLines_;
+
 };
 
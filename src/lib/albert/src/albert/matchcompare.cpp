@@ -14,55 +14,221 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <QDebug>
+#include <QMutex>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlError>
 #include <QVariant>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include "item.h"
 #include "matchcompare.h"
 using namespace std;
 
+namespace {
+
+// The time in days after which a usage counts half
+const double HALF_LIFE = 7;
+
+const double DECAY = std::log(2.0) / HALF_LIFE;
+
+// The julian day the time invariant scores are relative to, 2017-09-04.
+// Small invariants leave more bits of the mantissa to the keys.
+const double EPOCH = 2458000;
+
+// The number of characters of an input that condition the order
+const int MAX_PREFIX_LENGTH = 8;
+
+// The number of items kept per prefix, the ranks have to fit in 5 bits
+const int MAX_PREFIX_ITEMS = 16;
+
+// The number of prefixes kept, usages of new prefixes are dropped beyond
+const int MAX_PREFIXES = 8192;
+
+QString normalizedInput(const QString &input) {
+    return input.trimmed().toLower().left(MAX_PREFIX_LENGTH);
+}
+
+// Serializes the modifications of the usage and prefix scores
+QMutex updateMutex;
+
+}
+
 
 /** ***************************************************************************/
-map<QString, double> Core::MatchCompare::order;
+shared_ptr<const Core::ShardedHash<uint64_t>> Core::MatchCompare::usageKeys = std::make_shared<Core::ShardedHash<uint64_t>>();
 
 /** ***************************************************************************/
-bool Core::MatchCompare::operator()(const pair<shared_ptr<Item>, short> &lhs,
-                                  const pair<shared_ptr<Item>, short> &rhs) {
-    // Compare urgency
-    if (lhs.first->urgency() != rhs.first->urgency())
-        return lhs.first->urgency() > rhs.first->urgency();
-
-    // Compare usage scores
-    const map<QString,double>::iterator &lit = order.find(lhs.first->id());
-    const map<QString,double>::iterator &rit = order.find(rhs.first->id());
-    if (lit==order.cend()) // |- lhs zero
-        if (rit==order.cend()) // |- rhs zero
-            return lhs.second > rhs.second; // Compare match score
-        else // |- rhs > 0
-            return false; // lhs==0 && rhs>0 implies lhs<rhs implies !(lhs>rhs)
-    else
-        if (rit==order.cend())
-            return true; // lhs>0 && rhs=0 implies lhs>rhs
-        else
-            return lit->second > rit->second; // Both usage scores available, return lhs>rhs
+shared_ptr<const Core::ShardedHash<Core::MatchCompare::PrefixScores>> Core::MatchCompare::prefixScores
+        = std::make_shared<Core::ShardedHash<Core::MatchCompare::PrefixScores>>();
+
+/** ***************************************************************************/
+Core::MatchCompare::MatchCompare(const QString &input) : usageKeys_(std::atomic_load(&usageKeys)) {
+    // Rank the items of the longest known prefix of the input once, keys
+    // are a lookup then
+    const QString normalized = normalizedInput(input);
+    if (normalized.isEmpty())
+        return;
+    const shared_ptr<const ShardedHash<PrefixScores>> prefixes = std::atomic_load(&prefixScores);
+    for (int length = normalized.size(); length > 0; --length) {
+        const PrefixScores *prefix = prefixes->find(normalized.left(length));
+        if (!prefix)
+            continue;
+        vector<pair<uint64_t, QString>> items;
+        items.reserve(static_cast<size_t>(prefix->size()));
+        for (PrefixScores::const_iterator it = prefix->cbegin(); it != prefix->cend(); ++it)
+            items.emplace_back(usageKey(it.value()), it.key());
+        std::sort(items.begin(), items.end());
+        for (size_t i = 0; i < items.size(); ++i)
+            inputRanks_.insert(items[i].second, i + 1);
+        break;
+    }
 }
 
+/** ***************************************************************************/
+uint64_t Core::MatchCompare::key(const Item &item, short score) const {
+    // Urgency first, then the rank for the input and the usage score. The
+    // match score matters only if there is no usage score.
+    const QString id = item.id();
+    const uint64_t urgency = static_cast<uint64_t>(item.urgency());
+    const uint64_t inputRank = inputRanks_.isEmpty() ? 0 : inputRanks_.value(id, 0);
+    const uint64_t usage = usageKeys_->value(id, 0);
+    const uint64_t matchScore = (usage == 0) ? static_cast<uint64_t>(score + 32768) : 0;
+    return urgency << 56 | inputRank << 51 | usage << 16 | matchScore;
+}
 
 /** ***************************************************************************/
-void Core::MatchCompare::update() {
-    order.clear();
+Core::MatchCompare::UsageScore Core::MatchCompare::addUsage(const UsageScore &score, double time) {
+    return {score.score * std::exp(-DECAY * (time - score.time)) + 1, time};
+}
 
-    // Update the results ranking
+/** ***************************************************************************/
+uint64_t Core::MatchCompare::usageKey(const UsageScore &score) {
+    /*
+     * The score decayed to time t is score*exp(-DECAY*(t-time)). The common
+     * factor exp(-DECAY*t) does not change the order, hence the logarithm of
+     * score*exp(DECAY*(time-EPOCH)) orders the scores at any time. It is
+     * positive for scores of at least one after the epoch. The bits of a
+     * positive double compare like its value, the upper 35 bits make a
+     * nonzero key.
+     */
+    const double invariant = std::log(score.score) + DECAY * (score.time - EPOCH);
+    if (!(invariant > 0))
+        return 1;
+    uint64_t bits;
+    std::memcpy(&bits, &invariant, sizeof(bits));
+    return std::max<uint64_t>(bits >> 28, 1);
+}
+
+/** ***************************************************************************/
+void Core::MatchCompare::update() {
+    shared_ptr<ShardedHash<uint64_t>> newKeys = std::make_shared<ShardedHash<uint64_t>>();
     QSqlQuery query;
-    query.exec("SELECT t.itemId AS id, SUM(t.score) AS usageScore "
-               "FROM ( "
-               " SELECT itemId, 1/max(julianday('now')-julianday(timestamp),1) AS score "
-               " FROM usages "
-               " WHERE itemId<>'' "
-               ") t "
-               "GROUP BY t.itemId");
+    if (!query.exec("SELECT itemId, score, timestamp FROM usage_scores;"))
+        qWarning() << query.lastError();
+    while (query.next()) {
+        const QString itemId = query.value(0).toString();
+        newKeys->shard(itemId).insert(itemId, usageKey({query.value(1).toDouble(), query.value(2).toDouble()}));
+    }
+
+    shared_ptr<ShardedHash<PrefixScores>> newPrefixes = std::make_shared<ShardedHash<PrefixScores>>();
+    if (!query.exec("SELECT input, itemId, julianday(timestamp) FROM usages "
+                    "WHERE itemId<>'' AND input<>'' ORDER BY timestamp;"))
+        qWarning() << query.lastError();
     while (query.next())
-        MatchCompare::order.emplace(query.value(0).toString(),
-                                    query.value(1).toDouble());
+        addInputUsage(*newPrefixes, {query.value(0).toString(), query.value(1).toString(), query.value(2).toDouble()});
+
+    QMutexLocker lock(&updateMutex);
+    std::atomic_store(&usageKeys, shared_ptr<const ShardedHash<uint64_t>>(newKeys));
+    std::atomic_store(&prefixScores, shared_ptr<const ShardedHash<PrefixScores>>(newPrefixes));
+}
+
+/** ***************************************************************************/
+void Core::MatchCompare::addInputUsage(ShardedHash<PrefixScores> &prefixes, const InputUsage &usage) {
+    const QString normalized = normalizedInput(usage.input);
+    for (int length = 1; length <= normalized.size(); ++length) {
+        const QString prefix = normalized.left(length);
+        if (!prefixes.find(prefix) && prefixes.size() >= MAX_PREFIXES)
+            return;
+        QHash<QString, PrefixScores> &shard = prefixes.shard(prefix);
+        QHash<QString, PrefixScores>::iterator scores = shard.find(prefix);
+        if (scores == shard.end())
+            scores = shard.insert(prefix, PrefixScores());
+
+        PrefixScores::iterator it = scores->find(usage.itemId);
+        if (it != scores->end()) {
+            *it = addUsage(*it, usage.time);
+            continue;
+        }
+
+        // Replace the lowest score if the prefix is full, a fresh usage
+        // outranks the ones that decayed below one
+        const UsageScore score{1, usage.time};
+        if (scores->size() >= MAX_PREFIX_ITEMS) {
+            PrefixScores::iterator lowest = scores->begin();
+            for (PrefixScores::iterator candidate = scores->begin(); candidate != scores->end(); ++candidate)
+                if (usageKey(*candidate) < usageKey(*lowest))
+                    lowest = candidate;
+            if (usageKey(*lowest) >= usageKey(score))
+                continue;
+            scores->erase(lowest);
+        }
+        scores->insert(usage.itemId, score);
+    }
+}
+
+/** ***************************************************************************/
+void Core::MatchCompare::rebuildScores() {
+    QHash<QString, UsageScore> scores;
+    QSqlQuery query;
+    if (!query.exec("SELECT itemId, julianday(timestamp) FROM usages WHERE itemId<>'' ORDER BY timestamp;"))
+        qWarning() << query.lastError();
+    while (query.next()) {
+        const QString itemId = query.value(0).toString();
+        const double time = query.value(1).toDouble();
+        QHash<QString, UsageScore>::iterator it = scores.find(itemId);
+        if (it == scores.end())
+            scores.insert(itemId, {1, time});
+        else
+            *it = addUsage(*it, time);
+    }
+
+    if (!query.exec("DELETE FROM usage_scores;"))
+        qWarning() << query.lastError();
+    query.prepare("INSERT INTO usage_scores (itemId, score, timestamp) VALUES (:itemId, :score, :timestamp);");
+    for (QHash<QString, UsageScore>::const_iterator it = scores.cbegin(); it != scores.cend(); ++it) {
+        query.bindValue(":itemId", it.key());
+        query.bindValue(":score", it->score);
+        query.bindValue(":timestamp", it->time);
+        if (!query.exec())
+            qWarning() << query.lastError();
+    }
+}
+
+/** ***************************************************************************/
+void Core::MatchCompare::updateScores(const vector<pair<QString, UsageScore>> &scores) {
+    QMutexLocker lock(&updateMutex);
+    // The copy shares all shards but the ones of the changed keys
+    shared_ptr<ShardedHash<uint64_t>> newKeys = std::make_shared<ShardedHash<uint64_t>>(*std::atomic_load(&usageKeys));
+    for (const pair<QString, UsageScore> &score : scores)
+        newKeys->shard(score.first).insert(score.first, usageKey(score.second));
+    std::atomic_store(&usageKeys, shared_ptr<const ShardedHash<uint64_t>>(newKeys));
+}
+
+/** ***************************************************************************/
+void Core::MatchCompare::addInputUsages(const vector<InputUsage> &usages) {
+    QMutexLocker lock(&updateMutex);
+    shared_ptr<ShardedHash<PrefixScores>> newPrefixes = std::make_shared<ShardedHash<PrefixScores>>(*std::atomic_load(&prefixScores));
+    for (const InputUsage &usage : usages)
+        addInputUsage(*newPrefixes, usage);
+    std::atomic_store(&prefixScores, shared_ptr<const ShardedHash<PrefixScores>>(newPrefixes));
+}
+
+/** ***************************************************************************/
+void Core::MatchCompare::clearScores() {
+    QMutexLocker lock(&updateMutex);
+    std::atomic_store(&usageKeys, shared_ptr<const ShardedHash<uint64_t>>(std::make_shared<ShardedHash<uint64_t>>()));
+    std::atomic_store(&prefixScores, shared_ptr<const ShardedHash<PrefixScores>>(std::make_shared<ShardedHash<PrefixScores>>()));
 }
@@ -15,28 +15,115 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
+#include <QHash>
 #include <QString>
-#include <map>
+#include <cstdint>
 #include <memory>
+#include <utility>
+#include <vector>
 #include "item.h"
+#include "shardedhash.h"
 
 namespace Core {
 
 /**
  * @brief The MatchOrder class
- * The implements the order of the results
+ * The implements the order of the results. Matches are ordered by urgency,
+ * then by usage score, items that have not been used by match score. The
+ * order is resolved once per match into an integer key, sorting compares the
+ * keys only. A compare uses the usage scores current at its construction,
+ * hence the scores can be updated while other threads sort.
+ *
+ * The usage score of an item is the sum of its usages decayed exponentially
+ * by their age. It is maintained incrementally in the usage_scores table,
+ * see addUsage, and decays lazily: Scores are compared in a time invariant
+ * form, hence they never have to be recomputed.
+ *
+ * Before the usage score come the preferences for the input. Every usage
+ * also counts for the prefixes of the input it was chosen for. The items
+ * most used for the longest known prefix of the input of a compare rank
+ * before all other items of the same urgency. The prefix scores are kept
+ * in memory only, with a bounded number of prefixes and items per prefix.
+ *
+ * Both maps are sharded, an update copies the shards of the changed keys.
  */
 class MatchCompare
 {
 public:
 
+    /** A usage score as of a time in julian days */
+    struct UsageScore {
+        double score;
+        double time;
+    };
+
+    /** An item chosen for an input */
+    struct InputUsage {
+        QString input;
+        QString itemId;
+        double time;
+    };
+
+    /** Constructs the compare for matches of the input */
+    explicit MatchCompare(const QString &input = QString());
+
+    /**
+     * @brief Loads the usage scores
+     * Reads the usage_scores table and builds the prefix scores from the
+     * usages table. Runs in a task of the DatabaseWorker.
+     */
     static void update();
-    bool operator()(const std::pair<std::shared_ptr<Item>, short>& lhs,
-                    const std::pair<std::shared_ptr<Item>, short>& rhs);
+
+    /**
+     * @brief Recomputes the usage_scores table from the usages table
+     * Costs time linear in the history, needed only if there are usages but
+     * no scores, i.e. on the first run after an upgrade. Runs in a task of the
+     * DatabaseWorker.
+     */
+    static void rebuildScores();
+
+    /**
+     * @brief Changes the scores of the given items
+     * Copies the shards of the keys in memory, there is no database access.
+     * Thread safe.
+     */
+    static void updateScores(const std::vector<std::pair<QString, UsageScore>> &scores);
+
+    /**
+     * @brief Adds usages to the prefix scores of their inputs
+     * There is no database access. Thread safe.
+     */
+    static void addInputUsages(const std::vector<InputUsage> &usages);
+
+    /** Drops all usage and prefix scores. Thread safe. */
+    static void clearScores();
+
+    /** The score after adding a usage at time to a score */
+    static UsageScore addUsage(const UsageScore &score, double time);
+
+    /** The sort key of a match, higher keys rank first */
+    uint64_t key(const Item &item, short score) const;
 
 private:
 
-    static std::map<QString, double> order;
+    // The scores of the items chosen for a prefix
+    typedef QHash<QString, UsageScore> PrefixScores;
+
+    static uint64_t usageKey(const UsageScore &score);
+    static void addInputUsage(ShardedHash<PrefixScores> &prefixes, const InputUsage &usage);
+
+    std::shared_ptr<const ShardedHash<uint64_t>> usageKeys_;
+
+    // The ranks of the items most used for the input, higher is better
+    QHash<QString, uint64_t> inputRanks_;
+
+    // The time invariant keys of the usage scores of the used items.
+    // Accessed atomically only.
+    static std::shared_ptr<const ShardedHash<uint64_t>> usageKeys;
+
+    // The scores of the items per normalized input prefix. Accessed
+    // atomically only.
+    static std::shared_ptr<const ShardedHash<PrefixScores>> prefixScores;
 };
 
 }
@@ -15,13 +15,10 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFutureWatcher>
 #include <QMutex>
-#include <QSqlQuery>
-#include <QSqlRecord>
-#include <QSqlError>
 #include <QString>
-#include <QtConcurrent>
 #include <QTimer>
 #include <QVariant>
 #include <algorithm>
@@ -29,38 +26,78 @@
 #include <map>
 #include <functional>
 #include "action.h"
+#include "databaseworker.h"
 #include "extension.h"
 #include "item.h"
 #include "matchcompare.h"
 #include "query.h"
+#include "queryexecutor.h"
 using std::chrono::system_clock;
 using namespace std;
 
+namespace {
+
+// The number of top results kept in order when results arrive late. Later
+// matches ranked below are appended in blocks, the rows there are hardly
+// visible and reordering them would only cost frame time.
+const size_t SORTED_RESULTS = 100;
+
+// The number of top results whose changes are profiled
+const size_t TOP_RESULTS = 5;
+
+// An item and its sort key, see MatchCompare
+typedef pair<shared_ptr<Core::Item>,uint64_t> Match;
+
+bool ranksBefore(const Match &lhs, const Match &rhs) {
+    return lhs.second > rhs.second;
+}
+
+}
+
 
 /** ***************************************************************************/
 class Core::Query::QueryPrivate : public QAbstractListModel
 {
 public:
-    QueryPrivate(Query *q) : q(q), isValid(true), state(State::Idle) { }
+    QueryPrivate(Query *q) : q(q), state(State::Idle) { }
 
     Query *q;
 
     QString searchTerm;
-    bool isValid;
+    MatchCompare compare; // Conditioned on the search term
+    CancellationToken cancellationToken;
     Query::State state;
 
     set<QueryHandler*> syncHandlers;
     set<QueryHandler*> asyncHandlers;
-    map<QString,uint> runtimes;
 
-    vector<shared_ptr<Item>> results;
+    vector<Match> results;
     vector<shared_ptr<Item>> fallbacks;
 
     QTimer fiftyMsTimer;
     mutable QMutex pendingResultsMutex;
-    vector<pair<shared_ptr<Item>, short>> pendingResults;
 
-    QFutureWatcher<pair<QueryHandler*,uint>> futureWatcher;
+    // The matches added since the last insertion, in runs sorted by the
+    // handler threads
+    vector<vector<Match>> pendingRuns;
+
+    // The states the handlers attached to refine the next query from, the
+    // handlers that answered before the query got canceled and their
+    // runtimes, guarded by pendingResultsMutex
+    map<QueryHandler*,shared_ptr<void>> refinementStates;
+    set<QueryHandler*> completeHandlers;
+    map<QString,uint> runtimes;
+
+    // The states attached to the previous query, read only while running
+    map<QueryHandler*,shared_ptr<void>> previousStates;
+
+    QFutureWatcher<void> futureWatcher;
+
+    // The time the query is running and the times in microseconds it showed
+    // its first result and changed its top results last, -1 if it did not
+    QElapsedTimer runTime;
+    qint64 firstResultTime = -1;
+    qint64 topChangeTime = -1;
 
 
 
@@ -68,6 +105,8 @@ public:
     /** ***************************************************************************/
     void run() {
 
+        runTime.start();
+
         if ( !syncHandlers.empty() )
             return runSyncHandlers();
 
@@ -82,11 +121,30 @@ public:
 
 
     /** ***************************************************************************/
-    pair<QueryHandler*,uint> mappedFunction (QueryHandler* queryHandler) {
+    void mappedFunction (QueryHandler* queryHandler) {
+
+        // Do not start handlers of a query that is dead already
+        if (cancellationToken.isCanceled()) {
+            QMutexLocker lock(&pendingResultsMutex);
+            refinementStates.erase(queryHandler);
+            return;
+        }
+
         system_clock::time_point then = system_clock::now();
-        queryHandler->handleQuery(q);
+        map<QueryHandler*,shared_ptr<void>>::const_iterator it = previousStates.find(queryHandler);
+        if (it != previousStates.cend())
+            queryHandler->handleRefinement(q, it->second);
+        else
+            queryHandler->handleQuery(q);
         system_clock::time_point now = system_clock::now();
-        return std::make_pair(queryHandler, std::chrono::duration_cast<std::chrono::microseconds>(now-then).count());
+
+        // Only complete answers can be refined and have meaningful runtimes
+        QMutexLocker lock(&pendingResultsMutex);
+        if (!cancellationToken.isCanceled()) {
+            completeHandlers.insert(queryHandler);
+            runtimes.emplace(queryHandler->id, std::chrono::duration_cast<std::chrono::microseconds>(now-then).count());
+        } else
+            refinementStates.erase(queryHandler);
     }
 
 
@@ -95,13 +153,14 @@ public:
 
         // Call onSyncHandlersFinsished when all handlers finished
         futureWatcher.disconnect();
-        connect(&futureWatcher, &QFutureWatcher<pair<QueryHandler*,uint>>::finished,
+        connect(&futureWatcher, &QFutureWatcher<void>::finished,
                 this, &QueryPrivate::onSyncHandlersFinsished);
 
         // Run the handlers concurrently and measure the runtimes
-        futureWatcher.setFuture(QtConcurrent::mapped(syncHandlers.begin(),
-                                                     syncHandlers.end(),
-                                                     std::bind(&QueryPrivate::mappedFunction, this, std::placeholders::_1)));
+        futureWatcher.setFuture(QueryExecutor::instance->map(QueryExecutor::Lane::Interactive,
+                                                             syncHandlers.begin(),
+                                                             syncHandlers.end(),
+                                                             std::bind(&QueryPrivate::mappedFunction, this, std::placeholders::_1)));
     }
 
 
@@ -110,13 +169,14 @@ public:
 
         // Call onAsyncHandlersFinsished when all handlers finished
         futureWatcher.disconnect();
-        connect(&futureWatcher, &QFutureWatcher<pair<QueryHandler*,uint>>::finished,
+        connect(&futureWatcher, &QFutureWatcher<void>::finished,
                 this, &QueryPrivate::onAsyncHandlersFinsished);
 
         // Run the handlers concurrently and measure the runtimes
-        futureWatcher.setFuture(QtConcurrent::mapped(asyncHandlers.begin(),
-                                                     asyncHandlers.end(),
-                                                     std::bind(&QueryPrivate::mappedFunction, this, std::placeholders::_1)));
+        futureWatcher.setFuture(QueryExecutor::instance->map(QueryExecutor::Lane::Interactive,
+                                                             asyncHandlers.begin(),
+                                                             asyncHandlers.end(),
+                                                             std::bind(&QueryPrivate::mappedFunction, this, std::placeholders::_1)));
 
         // Insert pending results every 50 milliseconds
         connect(&fiftyMsTimer, &QTimer::timeout, this, &QueryPrivate::insertPendingResults);
@@ -128,32 +188,8 @@ public:
     /** ***************************************************************************/
     void onSyncHandlersFinsished() {
 
-        // Save the runtimes of the current future
-        for ( auto it = futureWatcher.future().begin(); it != futureWatcher.future().end(); ++it )
-            runtimes.emplace(it->first->id, it->second);
-
-        /*
-         * Publish the results
-         */
-
-        // Lock the pending results
-        QMutexLocker lock(&pendingResultsMutex);
-
-        // Sort the results
-        std::sort(pendingResults.begin(),
-                  pendingResults.end(),
-                  MatchCompare());
-
-        // Preallocate space in "results" to avoid multiple allocations
-        results.reserve(results.size() + pendingResults.size());
-
-        // Move the items of the "pending results" into "results"
-        std::transform(pendingResults.begin(),
-                       pendingResults.end(),
-                       std::back_inserter(results),
-                       [](const pair<shared_ptr<Item>,short>& p){ return std::move(p.first); });
-
-        pendingResults.clear();
+        // Publish the results, the model is not displayed yet
+        insertPendingResults();
 
         emit q->resultsReady(this);
 
@@ -167,10 +203,6 @@ public:
     /** ***************************************************************************/
     void onAsyncHandlersFinsished() {
 
-        // Save the runtimes of the current future
-        for ( auto it = futureWatcher.future().begin(); it != futureWatcher.future().end(); ++it )
-            runtimes.emplace(it->first->id, it->second);
-
         // Finally done
         fiftyMsTimer.stop();
         fiftyMsTimer.disconnect();
@@ -183,25 +215,80 @@ public:
     /** ***************************************************************************/
     void insertPendingResults() {
 
-        if(pendingResults.size()) {
-
+        vector<vector<Match>> runs;
+        {
             QMutexLocker lock(&pendingResultsMutex);
+            runs.swap(pendingRuns);
+        }
+        if (runs.empty())
+            return;
+
+        vector<Match> matches = mergeRuns(runs);
+
+        // Insert the groups of matches ranked before a result in front of it
+        vector<Match>::iterator match = matches.begin();
+        size_t row = 0;
+        while (match != matches.end()) {
+            while (row < results.size() && row < SORTED_RESULTS && !ranksBefore(*match, results[row]))
+                ++row;
+            if (row >= SORTED_RESULTS)
+                row = results.size();
+            vector<Match>::iterator end = matches.end();
+            if (row < results.size())
+                end = std::find_if(match, matches.end(),
+                                   [&](const Match &m){ return !ranksBefore(m, results[row]); });
+            const size_t count = static_cast<size_t>(end - match);
+            beginInsertRows(QModelIndex(), static_cast<int>(row), static_cast<int>(row + count - 1));
+            results.insert(results.begin() + static_cast<ptrdiff_t>(row),
+                           std::make_move_iterator(match),
+                           std::make_move_iterator(end));
+            endInsertRows();
+            noteInsertion(row);
+            row += count;
+            match = end;
+        }
+    }
 
-            beginInsertRows(QModelIndex(), results.size(), results.size() + pendingResults.size() - 1);
-
-            // Preallocate space to avoid multiple allocatoins
-            results.reserve(results.size() + pendingResults.size());
 
-            // Copy the items of the matches into the results
-            std::transform(pendingResults.begin(), pendingResults.end(),
-                           std::back_inserter(results),
-                           [](const pair<shared_ptr<Item>,short>& p){ return std::move(p.first); });
+    /** ***************************************************************************/
+    void noteInsertion(size_t row) {
+        const qint64 now = runTime.nsecsElapsed() / 1000;
+        if (firstResultTime < 0)
+            firstResultTime = now;
+        if (row < TOP_RESULTS)
+            topChangeTime = now;
+    }
 
-            endInsertRows();
 
-            // Clear the empty matches
-            pendingResults.clear();
+    /** ***************************************************************************/
+    static vector<Match> mergeRuns(vector<vector<Match>> &runs) {
+
+        if (runs.size() == 1)
+            return std::move(runs.front());
+
+        // Merge the runs using a heap with the best head on top
+        typedef pair<vector<Match>::iterator,vector<Match>::iterator> Cursor;
+        vector<Cursor> heap;
+        size_t size = 0;
+        for (vector<Match> &run : runs) {
+            heap.emplace_back(run.begin(), run.end());
+            size += run.size();
+        }
+        auto worse = [](const Cursor &lhs, const Cursor &rhs){ return ranksBefore(*rhs.first, *lhs.first); };
+        std::make_heap(heap.begin(), heap.end(), worse);
+
+        vector<Match> matches;
+        matches.reserve(size);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), worse);
+            Cursor &cursor = heap.back();
+            matches.push_back(std::move(*cursor.first));
+            if (++cursor.first == cursor.second)
+                heap.pop_back();
+            else
+                std::push_heap(heap.begin(), heap.end(), worse);
         }
+        return matches;
     }
 
 
@@ -212,15 +299,15 @@ public:
          * If results are empty show fallbacks
          */
 
-        if( results.empty() ){
+        if( results.empty() && !fallbacks.empty() ){
             beginInsertRows(QModelIndex(), 0, fallbacks.size() - 1);
-            results.insert(results.end(),
-                           fallbacks.begin(),
-                           fallbacks.end());
+            for (const shared_ptr<Item> &fallback : fallbacks)
+                results.emplace_back(fallback, 0);
             endInsertRows();
+            noteInsertion(0);
         }
 
-        state = State::Finished;
+        state = (cancellationToken.isCanceled()) ? State::Canceled : State::Finished;
 
         emit q->finished();
     }
@@ -236,7 +323,7 @@ public:
     /** ***************************************************************************/
     QVariant data(const QModelIndex &index, int role) const override {
         if (index.isValid()) {
-            const shared_ptr<Item> &item = results[static_cast<size_t>(index.row())];
+            const shared_ptr<Item> &item = results[static_cast<size_t>(index.row())].first;
 
             switch (role) {
             case Qt::DisplayRole:
@@ -277,7 +364,7 @@ public:
     /** ***************************************************************************/
     bool setData(const QModelIndex &index, const QVariant &value, int role) override {
         if (index.isValid()) {
-            shared_ptr<Item> &item = results[static_cast<size_t>(index.row())];
+            shared_ptr<Item> &item = results[static_cast<size_t>(index.row())].first;
             QString itemId = item->id();
 
             switch (role) {
@@ -303,13 +390,8 @@ public:
                 break;
             }
 
-            // Save usage
-            QSqlQuery query;
-            query.prepare("INSERT INTO usages (input, itemId) VALUES (:input, :itemId);");
-            query.bindValue(":input", searchTerm);
-            query.bindValue(":itemId", item->id());
-            if (!query.exec())
-                qWarning() << query.lastError();
+            // Save usage, written in the background
+            DatabaseWorker::instance->addUsage(searchTerm, item->id());
         }
         return false;
     }
@@ -347,16 +429,27 @@ const QString &Core::Query::searchTerm() const {
 
 /** ***************************************************************************/
 bool Core::Query::isValid() const {
-    return d->isValid;
+    return !d->cancellationToken.isCanceled();
+}
+
+
+/** ***************************************************************************/
+const Core::CancellationToken &Core::Query::cancellationToken() const {
+    return d->cancellationToken;
 }
 
 
 /** ***************************************************************************/
 void Core::Query::addMatch(shared_ptr<Item> item, short score) {
-    if ( d->isValid ) {
-        d->pendingResultsMutex.lock();
-        d->pendingResults.push_back({item, score});
-        d->pendingResultsMutex.unlock();
+    if ( isValid() ) {
+        const uint64_t key = d->compare.key(*item, score);
+        Match match(std::move(item), key);
+        QMutexLocker lock(&d->pendingResultsMutex);
+        // Extend the last run as long as it stays sorted
+        if ( !d->pendingRuns.empty() && !ranksBefore(match, d->pendingRuns.back().back()) )
+            d->pendingRuns.back().push_back(std::move(match));
+        else
+            d->pendingRuns.emplace_back(1, std::move(match));
     }
 }
 
@@ -364,31 +457,60 @@ void Core::Query::addMatch(shared_ptr<Item> item, short score) {
 /** ***************************************************************************/
 void Core::Query::addMatches(vector<pair<shared_ptr<Item>,short>>::iterator begin,
                              vector<pair<shared_ptr<Item>,short>>::iterator end) {
-    if ( d->isValid ) {
-        d->pendingResultsMutex.lock();
-        d->pendingResults.insert(d->pendingResults.end(),
-                                 std::make_move_iterator(begin),
-                                 std::make_move_iterator(end));
-        d->pendingResultsMutex.unlock();
+    if ( isValid() && begin != end ) {
+        // Key and sort in the thread of the handler, the main thread merges
+        // the runs
+        vector<Match> run;
+        run.reserve(static_cast<size_t>(end - begin));
+        for ( auto it = begin; it != end; ++it ) {
+            const uint64_t key = d->compare.key(*it->first, it->second);
+            run.emplace_back(std::move(it->first), key);
+        }
+        std::stable_sort(run.begin(), run.end(), ranksBefore);
+        QMutexLocker lock(&d->pendingResultsMutex);
+        d->pendingRuns.push_back(std::move(run));
     }
 }
 
 
 /** ***************************************************************************/
 std::map<QString,uint> Core::Query::runtimes() {
+    QMutexLocker lock(&d->pendingResultsMutex);
     return d->runtimes;
 }
 
 
+/** ***************************************************************************/
+qint64 Core::Query::timeToFirstResult() const {
+    return d->firstResultTime;
+}
+
+
+/** ***************************************************************************/
+qint64 Core::Query::timeToStableTop() const {
+    return d->topChangeTime;
+}
+
+
+/** ***************************************************************************/
+void Core::Query::setRefinementState(QueryHandler *handler, shared_ptr<void> state) {
+    if ( isValid() ) {
+        QMutexLocker lock(&d->pendingResultsMutex);
+        d->refinementStates[handler] = std::move(state);
+    }
+}
+
+
 /** ***************************************************************************/
 void Core::Query::setSearchTerm(const QString &searchTerm) {
     d->searchTerm = searchTerm;
+    d->compare = MatchCompare(searchTerm);
 }
 
 
 /** ***************************************************************************/
 void Core::Query::invalidate() {
-    d->isValid = false;
+    d->cancellationToken.cancel();
 }
 
 /** ***************************************************************************/
@@ -415,6 +537,22 @@ void Core::Query::setFallbacks(const vector<shared_ptr<Core::Item> > &fallbacks)
 }
 
 
+/** ***************************************************************************/
+void Core::Query::setPreviousQuery(Query *previousQuery) {
+
+    if (d->state != State::Idle)
+        return;
+
+    // The handlers of the previous query may still be running
+    QMutexLocker lock(&previousQuery->d->pendingResultsMutex);
+    for ( QueryHandler *handler : previousQuery->d->completeHandlers ) {
+        auto it = previousQuery->d->refinementStates.find(handler);
+        if ( it != previousQuery->d->refinementStates.end() )
+            d->previousStates.insert(*it);
+    }
+}
+
+
 /** ***************************************************************************/
 void Core::Query::run() {
 
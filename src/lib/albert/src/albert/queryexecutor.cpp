@@ -0,0 +1,178 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <deque>
+#include "queryexecutor.h"
+using std::function;
+
+namespace {
+
+// The weight of the latest wait in the smoothed wait
+const double WAIT_SMOOTHING = 0.2;
+
+}
+
+namespace Core {
+
+class QueryExecutorPrivate
+{
+public:
+
+    typedef QueryExecutor::Lane Lane;
+
+    struct Task {
+        std::function<void()> function;
+        QElapsedTimer queued;
+    };
+
+    struct LaneState {
+        std::deque<Task> queue;
+        QueryExecutor::LaneMetrics metrics;
+    };
+
+    // Runs tasks until there is none it may start
+    class Worker final : public QRunnable
+    {
+    public:
+        Worker(QueryExecutorPrivate *d) : d(d) { }
+        void run() override { d->work(); }
+        QueryExecutorPrivate *d;
+    };
+
+    QThreadPool pool;
+    int backgroundLimit;
+
+    // Guards the lanes and the number of workers
+    QMutex mutex;
+    LaneState lanes[2];
+    int workers = 0;
+
+    LaneState &lane(Lane lane) { return lanes[static_cast<int>(lane)]; }
+    bool takeTask(Task &task, Lane &lane);
+    void work();
+};
+
+}
+
+
+
+/** ***************************************************************************/
+bool Core::QueryExecutorPrivate::takeTask(Task &task, Lane &lane) {
+    // Interactive tasks first, background tasks only if there are workers left
+    LaneState &interactive = this->lane(Lane::Interactive);
+    LaneState &background = this->lane(Lane::Background);
+    if (!interactive.queue.empty())
+        lane = Lane::Interactive;
+    else if (!background.queue.empty()
+             && static_cast<int>(background.metrics.running) < backgroundLimit)
+        lane = Lane::Background;
+    else
+        return false;
+
+    LaneState &state = this->lane(lane);
+    task = std::move(state.queue.front());
+    state.queue.pop_front();
+
+    QueryExecutor::LaneMetrics &metrics = state.metrics;
+    const qint64 wait = task.queued.elapsed();
+    metrics.averageWait = (metrics.started == 0)
+            ? wait : (1 - WAIT_SMOOTHING) * metrics.averageWait + WAIT_SMOOTHING * wait;
+    metrics.maxWait = std::max(metrics.maxWait, wait);
+    metrics.queueDepth = static_cast<uint>(state.queue.size());
+    ++metrics.started;
+    ++metrics.running;
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+void Core::QueryExecutorPrivate::work() {
+    QMutexLocker lock(&mutex);
+    Task task;
+    Lane lane = Lane::Interactive;
+    while (takeTask(task, lane)) {
+        lock.unlock();
+        task.function();
+        // Release the captures before taking the lock
+        task.function = nullptr;
+        lock.relock();
+        --this->lane(lane).metrics.running;
+    }
+    --workers;
+}
+
+
+
+/** ***************************************************************************/
+Core::QueryExecutor *Core::QueryExecutor::instance = nullptr;
+
+
+
+/** ***************************************************************************/
+Core::QueryExecutor::QueryExecutor(int threadCount) : d(new QueryExecutorPrivate) {
+    if (threadCount <= 0)
+        threadCount = QThread::idealThreadCount();
+    threadCount = std::max(threadCount, 2);
+    d->pool.setMaxThreadCount(threadCount);
+    d->backgroundLimit = threadCount - 1;
+}
+
+
+
+/** ***************************************************************************/
+Core::QueryExecutor::~QueryExecutor() {
+    // The workers drain the queues before they quit
+    d->pool.waitForDone();
+}
+
+
+
+/** ***************************************************************************/
+void Core::QueryExecutor::schedule(Lane lane, function<void()> task) {
+    QMutexLocker lock(&d->mutex);
+    QueryExecutorPrivate::LaneState &state = d->lane(lane);
+    state.queue.push_back({std::move(task), QElapsedTimer()});
+    state.queue.back().queued.start();
+    state.metrics.queueDepth = static_cast<uint>(state.queue.size());
+
+    // Busy workers pick the task up when they are done with their current one
+    if (d->workers < d->pool.maxThreadCount()) {
+        ++d->workers;
+        d->pool.start(new QueryExecutorPrivate::Worker(d.get()));
+    }
+}
+
+
+
+/** ***************************************************************************/
+Core::QueryExecutor::LaneMetrics Core::QueryExecutor::metrics(Lane lane) const {
+    QMutexLocker lock(&d->mutex);
+    return d->lane(lane).metrics;
+}
+
+
+
+/** ***************************************************************************/
+int Core::QueryExecutor::threadCount() const {
+    return d->pool.maxThreadCount();
+}
@@ -18,7 +18,10 @@
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlError>
+#include <algorithm>
+#include <map>
 #include <vector>
+#include "databaseworker.h"
 #include "extension.h"
 #include "extensionmanager.h"
 #include "fallbackprovider.h"
@@ -26,20 +29,56 @@
 #include "matchcompare.h"
 #include "query.h"
 #include "queryhandler.h"
+#include "queryprofiler.h"
 #include "querymanager.h"
 using namespace Core;
+using std::map;
+using std::pair;
 using std::set;
 using std::vector;
 using std::shared_ptr;
 
+namespace {
+
+// The weight of a new runtime in the moving average
+const double RUNTIME_SMOOTHING = 0.2;
+
+// The maximal time in milliseconds an input is held back
+const int MAX_COALESCING_DELAY = 100;
+
+}
+
 /** ***************************************************************************/
-QueryManager::QueryManager(ExtensionManager* em, QObject *parent)
+QueryManager::QueryManager(ExtensionManager* em, QueryProfiler *profiler, QObject *parent)
     : QObject(parent),
       extensionManager_(em),
-      currentQuery_(nullptr) {
+      profiler_(profiler),
+      currentQuery_(nullptr),
+      displayedQuery_(nullptr),
+      expectedRuntime_(0) {
 
     // Initialize the order
-    Core::MatchCompare::update();
+    DatabaseWorker::instance->execute([](){ Core::MatchCompare::update(); });
+
+    // Initialize the runtimes with the ones of the past sessions. Runtimes
+    // measured before they are loaded are more recent, keep them.
+    connect(&storedRuntimes_, &QFutureWatcher<map<QString,double>>::finished, this, [this](){
+        for (const pair<QString,double> &runtime : storedRuntimes_.result())
+            runtimes_.insert(runtime);
+    });
+    storedRuntimes_.setFuture(DatabaseWorker::instance->request([](){
+        map<QString,double> runtimes;
+        QSqlQuery sqlQuery;
+        if (sqlQuery.exec("SELECT extensionId, AVG(runtime) FROM runtimes GROUP BY extensionId;"))
+            while (sqlQuery.next())
+                runtimes[sqlQuery.value(0).toString()] = sqlQuery.value(1).toDouble();
+        else
+            qWarning() << sqlQuery.lastError();
+        return runtimes;
+    }));
+
+    coalescingTimer_.setSingleShot(true);
+    connect(&coalescingTimer_, &QTimer::timeout, this, [this](){ dispatchQuery(pendingSearchTerm_); });
 }
 
 
@@ -56,41 +95,37 @@ void QueryManager::setupSession() {
 /** ***************************************************************************/
 void QueryManager::teardownSession() {
 
+    // Drop the input that has not been dispatched yet. The stale query it
+    // waited for is in pastQueries_ already, inputs of the next session must
+    // not wait for it.
+    coalescingTimer_.stop();
+    pendingSearchTerm_.clear();
+    if ( currentQuery_ != nullptr && !currentQuery_->isValid() )
+        currentQuery_ = nullptr;
+
     // Call all teardown routines
     for (Core::QueryHandler *handler : extensionManager_->objectsByType<Core::QueryHandler>())
         handler->teardownSession();
 
-    // Open database to store the runtimes
-    QSqlDatabase db = QSqlDatabase::database();
-    QSqlQuery sqlQuery;
-    db.transaction();
-
-    // Delete finished queries and prepare sql transaction containing runtimes
-    vector<Query*>::iterator it = pastQueries_.begin();
-    while ( it != pastQueries_.end()){
-        if ( (*it)->state() != Query::State::Running ) {
-
-            // Store the runtimes
-            for ( const std::pair<QString,uint> &handlerRuntime : (*it)->runtimes() ) {
-                sqlQuery.prepare("INSERT INTO runtimes (extensionId, runtime) VALUES (:extensionId, :runtime);");
+    // Delete finished queries and store their runtimes in the background
+    deleteFinishedQueries(nullptr);
+    if ( !finishedRuntimes_.empty() ) {
+        vector<pair<QString,uint>> finishedRuntimes;
+        finishedRuntimes.swap(finishedRuntimes_);
+        DatabaseWorker::instance->execute([finishedRuntimes](){
+            QSqlQuery &sqlQuery = DatabaseWorker::instance->statement(
+                        "INSERT INTO runtimes (extensionId, runtime) VALUES (:extensionId, :runtime);");
+            for ( const pair<QString,uint> &handlerRuntime : finishedRuntimes ) {
                 sqlQuery.bindValue(":extensionId", handlerRuntime.first);
                 sqlQuery.bindValue(":runtime", handlerRuntime.second);
                 if (!sqlQuery.exec())
                     qWarning() << sqlQuery.lastError();
             }
-
-            // Delete the query
-            (*it)->deleteLater();
-            it = pastQueries_.erase(it);
-        } else
-            ++it;
+        });
     }
 
-    // Finally send the sql transaction
-    db.commit();
-
-    // Compute new match rankings
-    Core::MatchCompare::update();
+    // Write the usages of the session, this updates the match rankings too
+    DatabaseWorker::instance->flush();
 }
 
 
@@ -98,12 +133,43 @@ void QueryManager::teardownSession() {
 /** ***************************************************************************/
 void QueryManager::startQuery(const QString &searchTerm) {
 
-    if ( currentQuery_ != nullptr ) {
-        // Stop last query
+    // Dispatch immediately if the handlers are idle. Clearing is cheap.
+    if ( currentQuery_ == nullptr || currentQuery_->state() != Query::State::Running
+         || searchTerm.trimmed().isEmpty() ) {
+        dispatchQuery(searchTerm);
+        return;
+    }
+
+    // The running query is stale, hold the input back until it finished
+    if ( coalescingTimer_.isActive() )
+        profiler_->addDroppedInput();
+    pendingSearchTerm_ = searchTerm;
+    if ( currentQuery_->isValid() ) {
         disconnect(currentQuery_, &Query::resultsReady, this, &QueryManager::resultsReady);
         currentQuery_->invalidate();
-        // Store for later deletion (listview still has the model)
         pastQueries_.push_back(currentQuery_);
+        const qint64 remaining = static_cast<qint64>(expectedRuntime_ / 1000) - dispatchTime_.elapsed();
+        coalescingTimer_.start(static_cast<int>(std::max<qint64>(0, std::min<qint64>(remaining, MAX_COALESCING_DELAY))));
+    }
+}
+
+
+
+/** ***************************************************************************/
+void QueryManager::dispatchQuery(const QString &searchTerm) {
+
+    coalescingTimer_.stop();
+
+    Query *previousQuery = currentQuery_;
+    if ( currentQuery_ != nullptr ) {
+        if ( currentQuery_->isValid() ) {
+            // Stop last query
+            disconnect(currentQuery_, &Query::resultsReady, this, &QueryManager::resultsReady);
+            currentQuery_->invalidate();
+            // Store for later deletion (listview still has the model)
+            pastQueries_.push_back(currentQuery_);
+        }
+        currentQuery_ = nullptr;
     }
 
     // Do nothing if nothing is loaded
@@ -112,7 +178,7 @@ void QueryManager::startQuery(const QString &searchTerm) {
 
     // Do nothing if query is empty
     if ( searchTerm.trimmed().isEmpty() ) {
-        currentQuery_ = nullptr;
+        displayedQuery_ = nullptr;
         emit resultsReady(nullptr);
         return;
     }
@@ -139,11 +205,85 @@ void QueryManager::startQuery(const QString &searchTerm) {
                 actualHandlers.insert(handler);
 
 
+    // Expect the runtime of the slowest handler that blocks the first results
+    expectedRuntime_ = 0;
+    for ( QueryHandler *handler : actualHandlers )
+        if ( !handler->isLongRunning() ) {
+            auto it = runtimes_.find(handler->id);
+            if ( it != runtimes_.end() )
+                expectedRuntime_ = std::max(expectedRuntime_, it->second);
+        }
+    dispatchTime_.start();
+
     // Start query
-    currentQuery_ = new Query;
+    Query *query = new Query;
+    currentQuery_ = query;
     connect(currentQuery_, &Query::resultsReady, this, &QueryManager::resultsReady);
+    connect(currentQuery_, &Query::resultsReady, this, [this, query](){
+        // Stale queries emit too, but are not forwarded anymore
+        if ( query->isValid() && displayedQuery_ != query ) {
+            displayedQuery_ = query;
+            deleteFinishedQueries(displayedQuery_);
+        }
+    });
+    connect(currentQuery_, &Query::finished, this, [this, query](){ onQueryFinished(query); });
     currentQuery_->setSearchTerm(searchTerm);
     currentQuery_->setQueryHandlers(actualHandlers);
     currentQuery_->setFallbacks(fallbacks);
+    // Let the handlers refine the previous query if the term got extended
+    if ( previousQuery != nullptr && searchTerm.startsWith(previousQuery->searchTerm()) )
+        currentQuery_->setPreviousQuery(previousQuery);
     currentQuery_->run();
 }
+
+
+
+/** ***************************************************************************/
+void QueryManager::onQueryFinished(Query *query) {
+
+    // Profile the query
+    if ( query->isValid() )
+        profiler_->addFinishedQuery(query->timeToFirstResult(), query->timeToStableTop());
+    else
+        profiler_->addCanceledQuery();
+
+    // Update the moving averages of the runtimes
+    for ( const std::pair<QString,uint> &handlerRuntime : query->runtimes() ) {
+        profiler_->addHandlerRuntime(handlerRuntime.first, handlerRuntime.second);
+        auto it = runtimes_.find(handlerRuntime.first);
+        if ( it == runtimes_.end() )
+            runtimes_.emplace(handlerRuntime.first, handlerRuntime.second);
+        else
+            it->second += RUNTIME_SMOOTHING * (handlerRuntime.second - it->second);
+    }
+
+    // The handlers are idle now, dispatch the latest input
+    if ( query == currentQuery_ && coalescingTimer_.isActive() )
+        dispatchQuery(pendingSearchTerm_);
+
+    // Do not wait for the end of the session to free stale queries
+    if ( !query->isValid() )
+        deleteFinishedQueries(displayedQuery_);
+}
+
+
+
+/** ***************************************************************************/
+void QueryManager::deleteFinishedQueries(const Query *keep) {
+    vector<Query*>::iterator it = pastQueries_.begin();
+    while ( it != pastQueries_.end()){
+        if ( (*it)->state() != Query::State::Running && *it != keep ) {
+
+            // Keep the runtimes, they are stored on teardown
+            for ( const std::pair<QString,uint> &handlerRuntime : (*it)->runtimes() )
+                finishedRuntimes_.push_back(handlerRuntime);
+
+            // Delete the query
+            if ( *it == displayedQuery_ )
+                displayedQuery_ = nullptr;
+            (*it)->deleteLater();
+            it = pastQueries_.erase(it);
+        } else
+            ++it;
+    }
+}
@@ -17,12 +17,18 @@
 #pragma once
 #include <QObject>
 #include <QAbstractItemModel>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QTimer>
+#include <map>
+#include <utility>
 #include <vector>
 
 namespace Core {
 class ExtensionManager;
 class Query;
 }
+class QueryProfiler;
 
 class QueryManager : public QObject
 {
@@ -30,18 +36,54 @@ class QueryManager : public QObject
 
 public:
 
-    explicit QueryManager(Core::ExtensionManager* em, QObject *parent = 0);
+    QueryManager(Core::ExtensionManager* em, QueryProfiler *profiler, QObject *parent = 0);
 
     void setupSession();
     void teardownSession();
+
+    /**
+     * @brief Starts a query for the search term
+     * If the handlers are idle the query is dispatched immediately. While a
+     * query is running, i.e. the user types faster than the handlers answer,
+     * the running query is invalidated and the inputs are coalesced: Only the
+     * latest one is dispatched as soon as the running query finished, but not
+     * later than its expected runtime (capped) after it was dispatched.
+     */
     void startQuery(const QString &searchTerm);
 
 private:
 
+    void dispatchQuery(const QString &searchTerm);
+    void onQueryFinished(Core::Query *query);
+
+    /** Deletes the past queries that are not running except keep */
+    void deleteFinishedQueries(const Core::Query *keep);
+
     Core::ExtensionManager *extensionManager_;
+    QueryProfiler *profiler_;
     Core::Query *currentQuery_;
     std::vector<Core::Query*> pastQueries_;
 
+    // The query whose model the view shows, it must not be deleted
+    Core::Query *displayedQuery_;
+
+    // The runtimes of the deleted queries, stored on teardown
+    std::vector<std::pair<QString,uint>> finishedRuntimes_;
+
+    // The moving averages of the runtimes of the handlers in microseconds
+    std::map<QString,double> runtimes_;
+
+    // The runtimes of the past sessions, loaded in the background
+    QFutureWatcher<std::map<QString,double>> storedRuntimes_;
+
+    // The expected runtime of the current query and the time it is running
+    double expectedRuntime_;
+    QElapsedTimer dispatchTime_;
+
+    // The latest input, dispatched on timeout
+    QString pendingSearchTerm_;
+    QTimer coalescingTimer_;
+
 signals:
 
     void resultsReady(QAbstractItemModel*);
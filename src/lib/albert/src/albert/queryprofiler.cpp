@@ -0,0 +1,184 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QDateTime>
+#include <algorithm>
+#include <cmath>
+#include "queryexecutor.h"
+#include "queryprofiler.h"
+using Core::QueryExecutor;
+using std::map;
+
+namespace {
+
+// The buckets per power of two are 2^SUB_BUCKET_BITS
+const int SUB_BUCKET_BITS = 4;
+const qint64 SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+// Latencies are capped at 2^40 microseconds, about 12 days
+const int MAX_BITS = 40;
+const size_t BUCKET_COUNT = static_cast<size_t>((MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS);
+
+// Values below SUB_BUCKETS have a bucket each. Above, the upper
+// SUB_BUCKET_BITS+1 bits select the bucket within the power of two.
+size_t bucketIndex(qint64 value) {
+    if (value < SUB_BUCKETS)
+        return static_cast<size_t>(value);
+    int shift = 0;
+    while ((value >> shift) >= 2 * SUB_BUCKETS)
+        ++shift;
+    return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+}
+
+// The largest value of a bucket
+qint64 bucketLimit(size_t index) {
+    const qint64 i = static_cast<qint64>(index);
+    if (i < 2 * SUB_BUCKETS)
+        return i;
+    const qint64 shift = i / SUB_BUCKETS - 1;
+    return ((i - shift * SUB_BUCKETS + 1) << shift) - 1;
+}
+
+double toMsecs(qint64 usecs) {
+    return usecs / 1000.0;
+}
+
+QJsonObject laneToJson(const QueryExecutor::LaneMetrics &metrics) {
+    QJsonObject object;
+    object["queueDepth"] = static_cast<int>(metrics.queueDepth);
+    object["running"] = static_cast<int>(metrics.running);
+    object["started"] = static_cast<double>(metrics.started);
+    object["averageWaitMs"] = metrics.averageWait;
+    object["maxWaitMs"] = static_cast<double>(metrics.maxWait);
+    return object;
+}
+
+}
+
+
+
+/** ***************************************************************************/
+LatencyHistogram::LatencyHistogram()
+    : buckets_(BUCKET_COUNT, 0), count_(0), max_(0), sum_(0) {
+
+}
+
+
+
+/** ***************************************************************************/
+void LatencyHistogram::record(qint64 latency) {
+    latency = std::min(std::max<qint64>(latency, 0), (qint64(1) << MAX_BITS) - 1);
+    ++buckets_[bucketIndex(latency)];
+    ++count_;
+    max_ = std::max(max_, latency);
+    sum_ += latency;
+}
+
+
+
+/** ***************************************************************************/
+double LatencyHistogram::mean() const {
+    return (count_ == 0) ? 0 : sum_ / count_;
+}
+
+
+
+/** ***************************************************************************/
+qint64 LatencyHistogram::percentile(double p) const {
+    if (count_ == 0)
+        return 0;
+    const quint64 rank = std::max<quint64>(static_cast<quint64>(std::ceil(p * count_)), 1);
+    quint64 seen = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        seen += buckets_[i];
+        if (seen >= rank)
+            return std::min(bucketLimit(i), max_);
+    }
+    return max_;
+}
+
+
+
+/** ***************************************************************************/
+QJsonObject LatencyHistogram::toJson() const {
+    QJsonObject object;
+    object["count"] = static_cast<double>(count_);
+    object["meanMs"] = mean() / 1000;
+    object["p50Ms"] = toMsecs(percentile(0.50));
+    object["p95Ms"] = toMsecs(percentile(0.95));
+    object["p99Ms"] = toMsecs(percentile(0.99));
+    object["maxMs"] = toMsecs(max_);
+    return object;
+}
+
+
+
+/** ***************************************************************************/
+void QueryProfiler::addHandlerRuntime(const QString &handlerId, qint64 runtime) {
+    handlerRuntimes_[handlerId].record(runtime);
+}
+
+
+
+/** ***************************************************************************/
+void QueryProfiler::addFinishedQuery(qint64 firstResult, qint64 stableTop) {
+    ++finishedQueries_;
+    if (firstResult >= 0)
+        firstResult_.record(firstResult);
+    if (stableTop >= 0)
+        stableTop_.record(stableTop);
+}
+
+
+
+/** ***************************************************************************/
+QJsonObject QueryProfiler::toJson() const {
+    QJsonObject handlers;
+    for (const map<QString, LatencyHistogram>::value_type &handler : handlerRuntimes_)
+        handlers[handler.first] = handler.second.toJson();
+
+    QJsonObject queries;
+    queries["finished"] = static_cast<double>(finishedQueries_);
+    queries["canceled"] = static_cast<double>(canceledQueries_);
+    queries["droppedInputs"] = static_cast<double>(droppedInputs_);
+    queries["timeToFirstResult"] = firstResult_.toJson();
+    queries["timeToStableTop"] = stableTop_.toJson();
+
+    QJsonObject object;
+    object["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    object["handlers"] = handlers;
+    object["queries"] = queries;
+    if (QueryExecutor::instance != nullptr) {
+        QJsonObject executor;
+        executor["threads"] = QueryExecutor::instance->threadCount();
+        executor["interactive"] = laneToJson(QueryExecutor::instance->metrics(QueryExecutor::Lane::Interactive));
+        executor["background"] = laneToJson(QueryExecutor::instance->metrics(QueryExecutor::Lane::Background));
+        object["executor"] = executor;
+    }
+    return object;
+}
+
+
+
+/** ***************************************************************************/
+void QueryProfiler::reset() {
+    handlerRuntimes_.clear();
+    firstResult_ = LatencyHistogram();
+    stableTop_ = LatencyHistogram();
+    finishedQueries_ = 0;
+    canceledQueries_ = 0;
+    droppedInputs_ = 0;
+}
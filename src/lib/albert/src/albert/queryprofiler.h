@@ -0,0 +1,108 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QJsonObject>
+#include <QString>
+#include <QtGlobal>
+#include <map>
+#include <vector>
+
+/**
+ * @brief A histogram of latencies in microseconds
+ * The buckets are log-linear: Every power of two is split into 16 buckets of
+ * equal width, hence percentiles are off by less than 6.25%. Recording is
+ * constant time, memory is constant.
+ */
+class LatencyHistogram final
+{
+public:
+
+    LatencyHistogram();
+
+    void record(qint64 latency);
+
+    quint64 count() const { return count_; }
+    qint64 max() const { return max_; }
+    double mean() const;
+
+    /** The latency below which the fraction p of the recordings are */
+    qint64 percentile(double p) const;
+
+    /** The count and the percentiles in milliseconds */
+    QJsonObject toJson() const;
+
+private:
+
+    std::vector<quint64> buckets_;
+    quint64 count_;
+    qint64 max_;
+    double sum_;
+
+};
+
+
+/**
+ * @brief Collects the timings of the queries of the process
+ * Records the runtimes per query handler, the time a query takes to show its
+ * first result and the time until its top results are stable, as well as the
+ * canceled queries and the inputs dropped while coalescing. Used in the GUI
+ * thread only.
+ */
+class QueryProfiler final
+{
+public:
+
+    /** Records the runtime of a handler that answered a query */
+    void addHandlerRuntime(const QString &handlerId, qint64 runtime);
+
+    /**
+     * @brief Records a query that finished
+     * @param firstResult The time to the first result, negative if none
+     * @param stableTop The time to the last change of the top rows, negative
+     * if there were no results
+     */
+    void addFinishedQuery(qint64 firstResult, qint64 stableTop);
+
+    /** Records a query that was canceled before it finished */
+    void addCanceledQuery() { ++canceledQueries_; }
+
+    /** Records an input that has been replaced before it was dispatched */
+    void addDroppedInput() { ++droppedInputs_; }
+
+    const std::map<QString, LatencyHistogram> &handlerRuntimes() const { return handlerRuntimes_; }
+    const LatencyHistogram &firstResult() const { return firstResult_; }
+    const LatencyHistogram &stableTop() const { return stableTop_; }
+    quint64 finishedQueries() const { return finishedQueries_; }
+    quint64 canceledQueries() const { return canceledQueries_; }
+    quint64 droppedInputs() const { return droppedInputs_; }
+
+    /** The recordings and the state of the query executor */
+    QJsonObject toJson() const;
+
+    /** Drops all recordings */
+    void reset();
+
+private:
+
+    std::map<QString, LatencyHistogram> handlerRuntimes_;
+    LatencyHistogram firstResult_;
+    LatencyHistogram stableTop_;
+    quint64 finishedQueries_ = 0;
+    quint64 canceledQueries_ = 0;
+    quint64 droppedInputs_ = 0;
+
+};
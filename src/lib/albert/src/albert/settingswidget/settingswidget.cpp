@@ -18,30 +18,52 @@
 #include <QDebug>
 #include <QDesktopWidget>
 #include <QDir>
+#include <QFileDialog>
 #include <QFocusEvent>
+#include <QJsonDocument>
 #include <QMessageBox>
+#include <QSaveFile>
 #include <QSettings>
 #include <QShortcut>
-#include <QSqlQuery>
 #include <QStandardPaths>
 #include <vector>
 #include <utility>
 #include "core_globals.h"
+#include "databaseworker.h"
 #include "extension.h"
 #include "extensionspec.h"
 #include "extensionmanager.h"
 #include "hotkeymanager.h"
 #include "loadermodel.h"
 #include "mainwindow.h"
+#include "queryexecutor.h"
+#include "queryprofiler.h"
 #include "settingswidget.h"
 #include "trayicon.h"
 using Core::Extension;
 using Core::ExtensionSpec;
 using Core::ExtensionManager;
+using Core::QueryExecutor;
 
 namespace {
 const char* CFG_TERM = "terminal";
 const char* DEF_TERM = "xterm -e";
+
+// The interval in milliseconds the visible profile is updated in
+const int PROFILE_UPDATE_INTERVAL = 1000;
+
+QTreeWidgetItem *profileItem(QTreeWidgetItem *parent, const QString &name, const LatencyHistogram &histogram) {
+    QTreeWidgetItem *item = new QTreeWidgetItem(parent);
+    item->setText(0, name);
+    item->setText(1, QString::number(histogram.count()));
+    item->setText(2, QString::number(histogram.percentile(0.50) / 1000.0, 'f', 1));
+    item->setText(3, QString::number(histogram.percentile(0.95) / 1000.0, 'f', 1));
+    item->setText(4, QString::number(histogram.percentile(0.99) / 1000.0, 'f', 1));
+    item->setText(5, QString::number(histogram.max() / 1000.0, 'f', 1));
+    for (int column = 1; column < 6; ++column)
+        item->setTextAlignment(column, Qt::AlignRight | Qt::AlignVCenter);
+    return item;
+}
 }
 
 EXPORT_CORE QString terminalCommand;
@@ -52,12 +74,14 @@ SettingsWidget::SettingsWidget(MainWindow *mainWindow,
                                HotkeyManager *hotkeyManager,
                                ExtensionManager *extensionManager,
                                TrayIcon *systemTrayIcon,
+                               QueryProfiler *queryProfiler,
                                QWidget *parent, Qt::WindowFlags f)
     : QWidget(parent, f),
       mainWindow_(mainWindow),
       hotkeyManager_(hotkeyManager),
       extensionManager_(extensionManager),
-      trayIcon_(systemTrayIcon) {
+      trayIcon_(systemTrayIcon),
+      queryProfiler_(queryProfiler) {
 
     ui.setupUi(this);
 
@@ -203,7 +227,7 @@ SettingsWidget::SettingsWidget(MainWindow *mainWindow,
 
     // Cache
     connect(ui.pushButton_clearCache, &QPushButton::clicked, [](){
-        QSqlQuery("DELETE FROM usages;");
+        DatabaseWorker::instance->clear();
     });
 
 
@@ -225,6 +249,24 @@ SettingsWidget::SettingsWidget(MainWindow *mainWindow,
     ui.label_pluginTitle->hide();
 
 
+    /*
+     * PROFILER
+     */
+
+    // Update the profile while it is visible
+    connect(&profileTimer_, &QTimer::timeout, this, &SettingsWidget::updateProfile);
+    connect(ui.tabs, &QTabWidget::currentChanged, this, &SettingsWidget::updateProfile);
+    profileTimer_.start(PROFILE_UPDATE_INTERVAL);
+
+    connect(ui.pushButton_resetProfile, &QPushButton::clicked, [this](){
+        queryProfiler_->reset();
+        updateProfile();
+    });
+
+    connect(ui.pushButton_exportProfile, &QPushButton::clicked,
+            this, &SettingsWidget::exportProfile);
+
+
     /*
      * ABOUT
      */
@@ -328,6 +370,57 @@ void SettingsWidget::onPluginDataChanged(const QModelIndex &topLeft, const QMode
 
 
 
+/** ***************************************************************************/
+void SettingsWidget::updateProfile() {
+    if ( !isVisible() || ui.tabs->currentWidget() != ui.tabProfiler )
+        return;
+
+    ui.treeWidget_profiler->clear();
+
+    QTreeWidgetItem *queries = new QTreeWidgetItem(ui.treeWidget_profiler, QStringList("Queries"));
+    profileItem(queries, "First result", queryProfiler_->firstResult());
+    profileItem(queries, "Stable top 5", queryProfiler_->stableTop());
+
+    QTreeWidgetItem *handlers = new QTreeWidgetItem(ui.treeWidget_profiler, QStringList("Handlers"));
+    for (const auto &handlerRuntime : queryProfiler_->handlerRuntimes())
+        profileItem(handlers, handlerRuntime.first, handlerRuntime.second);
+
+    ui.treeWidget_profiler->expandAll();
+    ui.treeWidget_profiler->resizeColumnToContents(0);
+
+    const QueryExecutor::LaneMetrics interactive = QueryExecutor::instance->metrics(QueryExecutor::Lane::Interactive);
+    const QueryExecutor::LaneMetrics background = QueryExecutor::instance->metrics(QueryExecutor::Lane::Background);
+    ui.label_profilerSummary->setText(
+                QString("Queries: %1 finished, %2 canceled, %3 inputs dropped. "
+                        "Queue wait: interactive %4 ms (max %5 ms), background %6 ms (max %7 ms).")
+                .arg(queryProfiler_->finishedQueries())
+                .arg(queryProfiler_->canceledQueries())
+                .arg(queryProfiler_->droppedInputs())
+                .arg(interactive.averageWait, 0, 'f', 1)
+                .arg(interactive.maxWait)
+                .arg(background.averageWait, 0, 'f', 1)
+                .arg(background.maxWait));
+}
+
+
+
+/** ***************************************************************************/
+void SettingsWidget::exportProfile() {
+    const QString path = QFileDialog::getSaveFileName(this, "Export profile",
+                                                      QDir::home().filePath("albert-profile.json"),
+                                                      "JSON (*.json)");
+    if ( path.isEmpty() )
+        return;
+
+    QSaveFile file(path);
+    if ( !file.open(QIODevice::WriteOnly)
+         || file.write(QJsonDocument(queryProfiler_->toJson()).toJson()) < 0
+         || !file.commit() )
+        QMessageBox::warning(this, "Error", QString("Could not write %1: %2").arg(path, file.errorString()));
+}
+
+
+
 /** ***************************************************************************/
 void SettingsWidget::keyPressEvent(QKeyEvent *event) {
     if (event->modifiers() == Qt::NoModifier && event->key() == Qt::Key_Escape ) {
@@ -15,12 +15,14 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
+#include <QTimer>
 #include "ui_settingswidget.h"
 namespace Core {
 class ExtensionManager;
 }
 class HotkeyManager;
 class MainWindow;
+class QueryProfiler;
 class TrayIcon;
 
 class SettingsWidget final : public QWidget
@@ -33,6 +35,7 @@ public:
                    HotkeyManager *hotkeyManager,
                    Core::ExtensionManager *extensionManager,
                    TrayIcon *trayIcon,
+                   QueryProfiler *queryProfiler,
                    QWidget * parent = 0, Qt::WindowFlags f = 0);
 
 private:
@@ -43,11 +46,15 @@ private:
     void onPluginDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
     void changeHotkey(int);
     void updatePluginInformations(const QModelIndex & curr);
+    void updateProfile();
+    void exportProfile();
 
     MainWindow *mainWindow_;
     HotkeyManager *hotkeyManager_;
     Core::ExtensionManager *extensionManager_;
     TrayIcon *trayIcon_;
+    QueryProfiler *queryProfiler_;
+    QTimer profileTimer_;
     Ui::SettingsDialog ui;
 
 };
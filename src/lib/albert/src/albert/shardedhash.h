@@ -0,0 +1,88 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+#include <QHash>
+#include <QString>
+#include <memory>
+#include <vector>
+
+namespace Core {
+
+/**
+ * @brief The ShardedHash class
+ * A hash split into shards by the hash of the keys. Copies share the shards,
+ * a copy copies a shard on its first modification only. Hence modifying a
+ * few keys of a copy of a large hash costs a fraction of copying the hash.
+ */
+template <typename T>
+class ShardedHash final
+{
+public:
+
+    ShardedHash() : shards_(SHARD_COUNT), detached_(SHARD_COUNT, true) {
+        for (std::shared_ptr<QHash<QString, T>> &shard : shards_)
+            shard = std::make_shared<QHash<QString, T>>();
+    }
+
+    ShardedHash(const ShardedHash &other) : shards_(other.shards_), detached_(SHARD_COUNT, false) { }
+
+    ShardedHash &operator=(const ShardedHash &) = delete;
+
+    /** The value of the key, null if there is none */
+    const T *find(const QString &key) const {
+        const QHash<QString, T> &shard = *shards_[index(key)];
+        typename QHash<QString, T>::const_iterator it = shard.find(key);
+        return (it == shard.cend()) ? nullptr : &it.value();
+    }
+
+    T value(const QString &key, const T &defaultValue = T()) const {
+        return shards_[index(key)]->value(key, defaultValue);
+    }
+
+    /** The number of keys, linear in the number of shards */
+    int size() const {
+        int size = 0;
+        for (const std::shared_ptr<QHash<QString, T>> &shard : shards_)
+            size += shard->size();
+        return size;
+    }
+
+    /** The shard of the key for modification, copied if it is shared */
+    QHash<QString, T> &shard(const QString &key) {
+        const size_t i = index(key);
+        if (!detached_[i]) {
+            shards_[i] = std::make_shared<QHash<QString, T>>(*shards_[i]);
+            detached_[i] = true;
+        }
+        return *shards_[i];
+    }
+
+private:
+
+    static const uint SHARD_COUNT = 64;
+
+    static size_t index(const QString &key) { return qHash(key) % SHARD_COUNT; }
+
+    std::vector<std::shared_ptr<QHash<QString, T>>> shards_;
+
+    // The shards that are not shared with other hashes
+    std::vector<bool> detached_;
+
+};
+
+}
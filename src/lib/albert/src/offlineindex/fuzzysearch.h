@@ -16,38 +16,56 @@
 
 #pragma once
 #include <QString>
-#include <map>
 #include <memory>
+#include <utility>
 #include <vector>
-#include "prefixsearch.h"
+#include "offlineindex.h"
+#include "postinglist.h"
+#include "qgramindex.h"
 
 namespace Core {
 
-class FuzzySearch final : public PrefixSearch
+class Indexable;
+class PrefixSearch;
+
+/**
+ * @brief The FuzzySearch class
+ * An immutable overlay of a built snapshot of a prefix search that tolerates
+ * errors. The qGram index of the dictionary preselects the candidate terms,
+ * the dictionary and postings are shared with the snapshot.
+ */
+class FuzzySearch final
 {
 public:
 
-    explicit FuzzySearch(uint q = 3, double d = 1.0/3);
-    explicit FuzzySearch(const PrefixSearch& rhs, uint q = 3, double d = 1.0/3);
-    ~FuzzySearch();
+    explicit FuzzySearch(std::shared_ptr<const PrefixSearch> prefixSearch, uint q = 3);
+
+    /** The snapshot this overlay has been built for */
+    const std::shared_ptr<const PrefixSearch> &prefixSearch() const { return prefixSearch_; }
 
-    void add(std::shared_ptr<Indexable> idxble) override;
-    void clear() override;
-    std::vector<std::shared_ptr<Indexable>> search(const QString &req) const override;
-    inline double delta() const {return delta_;}
-    inline void setDelta(double d){delta_=d;}
+    /**
+     * @param delta If >1 the number of tolerated errors, else the fraction of
+     * the word length
+     */
+    std::vector<std::shared_ptr<Indexable>> search(const QString &req, double delta,
+                                                   const CancellationToken *token) const;
+    std::vector<std::pair<std::shared_ptr<Indexable>,short>> searchScored(const QString &req, double delta,
+                                                                     size_t limit,
+                                                                     OfflineIndex::Cursor *cursor,
+                                                                     const CancellationToken *token) const;
 
 private:
 
-    // Map of qGrams, containing their word references and #occurences
-    typedef std::map<QString,std::map<QString,uint>> QGramIndex;
+    /** The scored matches of every query word, none if canceled */
+    std::vector<ScoredPostingList> match(const QString &req, double delta, const CancellationToken *token) const;
+
+    const std::shared_ptr<const PrefixSearch> prefixSearch_;
+
+    // The qGrams of the terms of the dictionary
     QGramIndex qGramIndex_;
 
     // Size of the slices
-    uint q_;
-
-    // Maximum error
-    double delta_;
+    const uint q_;
 };
 
 }
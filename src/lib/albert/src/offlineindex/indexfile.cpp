@@ -0,0 +1,287 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QSaveFile>
+#include <cstring>
+#include "indexfile.h"
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+const char magic[8] = {'A','L','B','E','R','T','I','X'};
+const uint32_t version = 2;
+const uint32_t byteOrderMark = 0x01020304;
+
+// The sections of an inverted index
+enum IndexSection {
+    TermOffsets, TermPool, PostingOffsets, PostingPool, RelevancePool, MaxRelevances,
+    IndexSectionCount
+};
+
+// The sections of the file, the direct index, the derived index and the items
+enum Section {
+    Direct = 0,
+    Derived = IndexSectionCount,
+    WordCounts = 2 * IndexSectionCount, KeywordHashes, IdOffsets, IdPool, PayloadOffsets, PayloadPool,
+    SectionCount
+};
+
+// The flags of the header
+enum Flag {
+    FoldDiacritics = 1
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t itemCount;
+    uint32_t termCounts[2];
+    uint32_t flags;
+    uint64_t offsets[SectionCount];
+    uint64_t sizes[SectionCount];
+};
+
+const uint64_t alignment = 8;
+
+uint64_t align(uint64_t offset) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/** Lists the pools of the index starting at the section base */
+void describe(const Core::InvertedIndex::Arrays &arrays, int base, const void **data, Header &header) {
+    const uint64_t termCount = arrays.termCount;
+    const uint64_t postingCount = arrays.postingOffsets[termCount];
+    header.termCounts[base / IndexSectionCount] = arrays.termCount;
+    data[base + TermOffsets] = arrays.termOffsets;
+    data[base + TermPool] = arrays.termPool;
+    data[base + PostingOffsets] = arrays.postingOffsets;
+    data[base + PostingPool] = arrays.postingPool;
+    data[base + RelevancePool] = arrays.relevancePool;
+    data[base + MaxRelevances] = arrays.maxRelevances;
+    header.sizes[base + TermOffsets] = (termCount + 1) * sizeof(uint32_t);
+    header.sizes[base + TermPool] = arrays.termOffsets[termCount] * sizeof(QChar);
+    header.sizes[base + PostingOffsets] = (termCount + 1) * sizeof(uint32_t);
+    header.sizes[base + PostingPool] = postingCount * sizeof(uint32_t);
+    header.sizes[base + RelevancePool] = postingCount * sizeof(uint16_t);
+    header.sizes[base + MaxRelevances] = termCount * sizeof(uint16_t);
+}
+
+/** Whether count + 1 offsets ascend from zero, the pools depend on it */
+bool ascending(const uint32_t *offsets, uint64_t count) {
+    if (offsets[0] != 0)
+        return false;
+    for (uint64_t i = 0; i < count; ++i)
+        if (offsets[i] > offsets[i+1])
+            return false;
+    return true;
+}
+
+
+/** Whether the gap encoded ids of every term strictly ascend below itemCount */
+bool validPostings(const Core::InvertedIndex::Arrays &arrays, uint32_t itemCount) {
+    for (uint32_t termId = 0; termId < arrays.termCount; ++termId) {
+        const uint32_t first = arrays.postingOffsets[termId];
+        const uint32_t last = arrays.postingOffsets[termId+1];
+        uint64_t id = 0;
+        for (uint32_t i = first; i < last; ++i) {
+            if (i != first && arrays.postingPool[i] == 0)
+                return false;
+            id += arrays.postingPool[i];
+            if (id >= itemCount)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/** Points the arrays to the pools of the index starting at the section base */
+bool view(const uchar *data, const Header &header, int base, Core::InvertedIndex::Arrays &arrays) {
+    const uint64_t termCount = header.termCounts[base / IndexSectionCount];
+    if (header.sizes[base + TermOffsets] != (termCount + 1) * sizeof(uint32_t)
+            || header.sizes[base + PostingOffsets] != (termCount + 1) * sizeof(uint32_t)
+            || header.sizes[base + MaxRelevances] != termCount * sizeof(uint16_t))
+        return false;
+    arrays.termCount = static_cast<uint32_t>(termCount);
+    arrays.termOffsets = reinterpret_cast<const uint32_t*>(data + header.offsets[base + TermOffsets]);
+    arrays.termPool = reinterpret_cast<const QChar*>(data + header.offsets[base + TermPool]);
+    arrays.postingOffsets = reinterpret_cast<const uint32_t*>(data + header.offsets[base + PostingOffsets]);
+    arrays.postingPool = reinterpret_cast<const uint32_t*>(data + header.offsets[base + PostingPool]);
+    arrays.relevancePool = reinterpret_cast<const uint16_t*>(data + header.offsets[base + RelevancePool]);
+    arrays.maxRelevances = reinterpret_cast<const uint16_t*>(data + header.offsets[base + MaxRelevances]);
+    // The pools have to match the last offsets
+    const uint64_t postingCount = arrays.postingOffsets[termCount];
+    return ascending(arrays.termOffsets, termCount)
+            && ascending(arrays.postingOffsets, termCount)
+            && header.sizes[base + TermPool] == arrays.termOffsets[termCount] * sizeof(QChar)
+            && header.sizes[base + PostingPool] == postingCount * sizeof(uint32_t)
+            && header.sizes[base + RelevancePool] == postingCount * sizeof(uint16_t)
+            && validPostings(arrays, header.itemCount);
+}
+
+}
+
+
+/** ***************************************************************************/
+bool Core::IndexFile::write(const QString &path, const InvertedIndex &invertedIndex,
+                            const InvertedIndex &derivedIndex, const vector<Row> &rows,
+                            bool foldDiacritics) {
+
+    // Flatten the item table
+    vector<uint16_t> wordCounts;
+    vector<uint32_t> keywordHashes;
+    vector<uint32_t> idOffsets = {0};
+    vector<QChar> idPool;
+    vector<uint32_t> payloadOffsets = {0};
+    vector<QChar> payloadPool;
+    wordCounts.reserve(rows.size());
+    keywordHashes.reserve(rows.size());
+    idOffsets.reserve(rows.size() + 1);
+    payloadOffsets.reserve(rows.size() + 1);
+    for (const Row &row : rows) {
+        wordCounts.push_back(row.wordCount);
+        keywordHashes.push_back(row.keywordHash);
+        idPool.insert(idPool.end(), row.id.cbegin(), row.id.cend());
+        idOffsets.push_back(static_cast<uint32_t>(idPool.size()));
+        payloadPool.insert(payloadPool.end(), row.payload.cbegin(), row.payload.cend());
+        payloadOffsets.push_back(static_cast<uint32_t>(payloadPool.size()));
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.byteOrder = byteOrderMark;
+    header.itemCount = static_cast<uint32_t>(rows.size());
+    header.flags = (foldDiacritics) ? FoldDiacritics : 0;
+
+    const void *data[SectionCount];
+    describe(invertedIndex.arrays(), Direct, data, header);
+    describe(derivedIndex.arrays(), Derived, data, header);
+    const uint64_t itemCount = rows.size();
+    data[WordCounts] = wordCounts.data();
+    data[KeywordHashes] = keywordHashes.data();
+    data[IdOffsets] = idOffsets.data();
+    data[IdPool] = idPool.data();
+    data[PayloadOffsets] = payloadOffsets.data();
+    data[PayloadPool] = payloadPool.data();
+    header.sizes[WordCounts] = itemCount * sizeof(uint16_t);
+    header.sizes[KeywordHashes] = itemCount * sizeof(uint32_t);
+    header.sizes[IdOffsets] = (itemCount + 1) * sizeof(uint32_t);
+    header.sizes[IdPool] = idPool.size() * sizeof(QChar);
+    header.sizes[PayloadOffsets] = (itemCount + 1) * sizeof(uint32_t);
+    header.sizes[PayloadPool] = payloadPool.size() * sizeof(QChar);
+
+    uint64_t offset = align(sizeof(Header));
+    for (int section = 0; section < SectionCount; ++section) {
+        header.offsets[section] = offset;
+        offset = align(offset + header.sizes[section]);
+    }
+
+    // Write to a temporary file and rename it, a mapped file must not change
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    const char padding[alignment] = {};
+    uint64_t written = 0;
+    auto append = [&file, &written](const void *bytes, uint64_t size){
+        if (size != 0 && file.write(static_cast<const char*>(bytes), static_cast<qint64>(size)) != static_cast<qint64>(size))
+            return false;
+        written += size;
+        return true;
+    };
+    if (!append(&header, sizeof(Header))) {
+        file.cancelWriting();
+        return false;
+    }
+    for (int section = 0; section < SectionCount; ++section) {
+        if (!append(padding, header.offsets[section] - written)
+                || !append(data[section], header.sizes[section])) {
+            file.cancelWriting();
+            return false;
+        }
+    }
+    return file.commit();
+}
+
+
+/** ***************************************************************************/
+shared_ptr<const Core::IndexFile> Core::IndexFile::map(const QString &path) {
+
+    shared_ptr<IndexFile> indexFile(new IndexFile);
+    QFile &file = indexFile->file_;
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(Header)))
+        return shared_ptr<const IndexFile>();
+    const uint64_t fileSize = static_cast<uint64_t>(file.size());
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+        return shared_ptr<const IndexFile>();
+
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0
+            || header.version != version
+            || header.byteOrder != byteOrderMark)
+        return shared_ptr<const IndexFile>();
+
+    // Check that the sections are in bounds before reading the offsets
+    for (int section = 0; section < SectionCount; ++section)
+        if (header.offsets[section] % alignment != 0
+                || header.offsets[section] > fileSize
+                || header.sizes[section] > fileSize - header.offsets[section])
+            return shared_ptr<const IndexFile>();
+
+    if (!view(data, header, Direct, indexFile->arrays_)
+            || !view(data, header, Derived, indexFile->derivedArrays_))
+        return shared_ptr<const IndexFile>();
+
+    const uint64_t itemCount = header.itemCount;
+    if (header.sizes[WordCounts] != itemCount * sizeof(uint16_t)
+            || header.sizes[KeywordHashes] != itemCount * sizeof(uint32_t)
+            || header.sizes[IdOffsets] != (itemCount + 1) * sizeof(uint32_t)
+            || header.sizes[PayloadOffsets] != (itemCount + 1) * sizeof(uint32_t))
+        return shared_ptr<const IndexFile>();
+    indexFile->itemCount_ = header.itemCount;
+    indexFile->foldDiacritics_ = header.flags & FoldDiacritics;
+    indexFile->wordCounts_ = reinterpret_cast<const uint16_t*>(data + header.offsets[WordCounts]);
+    indexFile->keywordHashes_ = reinterpret_cast<const uint32_t*>(data + header.offsets[KeywordHashes]);
+    indexFile->idOffsets_ = reinterpret_cast<const uint32_t*>(data + header.offsets[IdOffsets]);
+    indexFile->idPool_ = reinterpret_cast<const QChar*>(data + header.offsets[IdPool]);
+    indexFile->payloadOffsets_ = reinterpret_cast<const uint32_t*>(data + header.offsets[PayloadOffsets]);
+    indexFile->payloadPool_ = reinterpret_cast<const QChar*>(data + header.offsets[PayloadPool]);
+    if (!ascending(indexFile->idOffsets_, itemCount)
+            || !ascending(indexFile->payloadOffsets_, itemCount)
+            || header.sizes[IdPool] != indexFile->idOffsets_[itemCount] * sizeof(QChar)
+            || header.sizes[PayloadPool] != indexFile->payloadOffsets_[itemCount] * sizeof(QChar))
+        return shared_ptr<const IndexFile>();
+
+    return indexFile;
+}
+
+
+/** ***************************************************************************/
+QString Core::IndexFile::id(uint32_t row) const {
+    return QString(idPool_ + idOffsets_[row], static_cast<int>(idOffsets_[row+1] - idOffsets_[row]));
+}
+
+
+/** ***************************************************************************/
+QString Core::IndexFile::payload(uint32_t row) const {
+    return QString(payloadPool_ + payloadOffsets_[row], static_cast<int>(payloadOffsets_[row+1] - payloadOffsets_[row]));
+}
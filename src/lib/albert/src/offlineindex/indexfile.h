@@ -0,0 +1,104 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "invertedindex.h"
+
+namespace Core {
+
+/**
+ * @brief The IndexFile class
+ * A versioned binary file holding the pools of the inverted index of the
+ * words, the one of the derived tokens and a table of the indexed items.
+ * Every item is stored as its id, a payload string, its word count and the
+ * hash of its keywords. The file is mapped read only and the pools are used
+ * in place, there is no deserialization step.
+ *
+ * Layout: A header followed by the sections listed in the header. Sections
+ * are 8 byte aligned arrays of native byte order. Strings are stored back to
+ * back in UTF-16 pools addressed by offset arrays like in the inverted index.
+ */
+class IndexFile final
+{
+public:
+
+    struct Row {
+        QString id;
+        QString payload;
+        uint16_t wordCount;
+        uint32_t keywordHash;
+    };
+
+    /**
+     * @brief Writes the inverted indexes and the rows of the items to path
+     * The file is replaced atomically, hence mappings of the previous file
+     * stay valid.
+     * @param foldDiacritics Whether the words were folded by the tokenizer
+     * @return False if the file could not be written
+     */
+    static bool write(const QString &path, const InvertedIndex &invertedIndex,
+                      const InvertedIndex &derivedIndex, const std::vector<Row> &rows,
+                      bool foldDiacritics);
+
+    /**
+     * @brief Maps the file at path
+     * The offsets and the postings are validated, which reads the pools once.
+     * @return Null if the file could not be mapped, has a different version or
+     * byte order, is truncated or corrupt
+     */
+    static std::shared_ptr<const IndexFile> map(const QString &path);
+
+    /** The pools of the inverted index, valid as long as this file lives */
+    const InvertedIndex::Arrays &arrays() const { return arrays_; }
+
+    /** The pools of the index of the derived tokens */
+    const InvertedIndex::Arrays &derivedArrays() const { return derivedArrays_; }
+
+    uint32_t itemCount() const { return itemCount_; }
+    bool foldDiacritics() const { return foldDiacritics_; }
+    const uint16_t *wordCounts() const { return wordCounts_; }
+    const uint32_t *keywordHashes() const { return keywordHashes_; }
+
+    /** The id of the item in row. The returned string owns its data. */
+    QString id(uint32_t row) const;
+
+    /** The payload of the item in row. The returned string owns its data. */
+    QString payload(uint32_t row) const;
+
+private:
+
+    IndexFile() {}
+
+    QFile file_;
+    InvertedIndex::Arrays arrays_;
+    InvertedIndex::Arrays derivedArrays_;
+    uint32_t itemCount_ = 0;
+    bool foldDiacritics_ = false;
+    const uint16_t *wordCounts_ = nullptr;
+    const uint32_t *keywordHashes_ = nullptr;
+    const uint32_t *idOffsets_ = nullptr;
+    const QChar *idPool_ = nullptr;
+    const uint32_t *payloadOffsets_ = nullptr;
+    const QChar *payloadPool_ = nullptr;
+
+};
+
+}
@@ -16,24 +16,38 @@
 
 #pragma once
 #include <QString>
-#include <vector>
 #include <memory>
+#include <utility>
+#include <vector>
+#include "cancellationtoken.h"
+#include "offlineindex.h"
 
 namespace Core {
 
 class Indexable;
 
+/** Whether the search has been canceled, the token may be null */
+inline bool isCanceled(const CancellationToken *token) {
+    return token && token->isCanceled();
+}
+
 class IndexImpl
 {
 public:
     virtual ~IndexImpl() {}
+    virtual IndexImpl *clone() const = 0;
+    virtual void build() const = 0;
     virtual void add(std::shared_ptr<Indexable> idxble) = 0;
+    virtual void update(std::shared_ptr<Indexable> idxble) = 0;
+    virtual void assign(const std::vector<std::shared_ptr<Indexable>> &idxbles) = 0;
+    virtual void remove(const QString &id) = 0;
     virtual void clear() = 0;
-    virtual std::vector<std::shared_ptr<Indexable>> search(const QString &req) const = 0;
-
-protected:
-    static constexpr const char* SEPARATOR_REGEX  = "[!?<>\"'=+*.:,;\\\\\\/ _\\-]+";
-
+    virtual bool save(const QString &path, const OfflineIndex::PayloadFunction &payload) const = 0;
+    virtual OfflineIndex::Statistics statistics() const = 0;
+    virtual std::vector<std::shared_ptr<Indexable>> search(const QString &req, const CancellationToken *token) const = 0;
+    virtual std::vector<std::pair<std::shared_ptr<Indexable>,short>> searchScored(const QString &req, size_t limit,
+                                                                             OfflineIndex::Cursor *cursor,
+                                                                             const CancellationToken *token) const = 0;
 };
 
 }
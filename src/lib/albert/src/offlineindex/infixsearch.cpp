@@ -0,0 +1,114 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <climits>
+#include "indexable.h"
+#include "indeximpl.h"
+#include "infixsearch.h"
+#include "prefixsearch.h"
+#include "tokenizer.h"
+using std::pair;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// Matches inside of a term are worth less than matches at its start
+const float INFIX_PENALTY = 0.75f;
+
+}
+
+
+
+/** ***************************************************************************/
+Core::InfixSearch::InfixSearch(std::shared_ptr<const PrefixSearch> prefixSearch)
+    : prefixSearch_(std::move(prefixSearch)) {
+    prefixSearch_->build();
+    suffixArray_.build(prefixSearch_->invertedIndex_);
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredPostingList> Core::InfixSearch::match(const QString &req, const CancellationToken *token) const {
+
+    const InvertedIndex &invertedIndex = prefixSearch_->invertedIndex_;
+
+    vector<ScoredPostingList> resultsPerWord;
+    vector<SuffixArray::Suffix> terms;
+    vector<uint32_t> ids;
+    vector<uint16_t> relevances;
+
+    Tokenizer tokenizer(req, prefixSearch_->fold_);
+    QString word;
+    while (tokenizer.next(word)) {
+
+        if (isCanceled(token))
+            return vector<ScoredPostingList>();
+
+        // Get the terms containing the word, the leftmost occurence counts
+        const pair<const SuffixArray::Suffix*, const SuffixArray::Suffix*> range = suffixArray_.find(invertedIndex, word);
+        terms.assign(range.first, range.second);
+        std::sort(terms.begin(), terms.end(), [](const SuffixArray::Suffix &lhs, const SuffixArray::Suffix &rhs){
+            return lhs.termId < rhs.termId || (lhs.termId == rhs.termId && lhs.offset < rhs.offset);
+        });
+        terms.erase(std::unique(terms.begin(), terms.end(), [](const SuffixArray::Suffix &lhs, const SuffixArray::Suffix &rhs){
+                        return lhs.termId == rhs.termId;
+                    }), terms.end());
+
+        // Unite the items referenced by the terms scoring them by the
+        // relevance of the keyword, the term coverage and the position
+        ScoredPostingList results;
+        for (const SuffixArray::Suffix &term : terms) {
+            const float quality = (0.5f + 0.5f * word.size() / invertedIndex.term(term.termId).size())
+                    * ((term.offset == 0) ? 1.0f : INFIX_PENALTY);
+            ids.clear();
+            relevances.clear();
+            invertedIndex.postings(term.termId, ids, relevances);
+            for (size_t i = 0; i < ids.size(); ++i)
+                results.push_back({ids[i], quality * relevances[i] / USHRT_MAX});
+        }
+        prefixSearch_->appendDerivedMatches(word, results);
+        makeScoredPostingList(results);
+
+        resultsPerWord.push_back(std::move(results));
+    }
+
+    return resultsPerWord;
+}
+
+
+
+/** ***************************************************************************/
+vector<shared_ptr<Core::Indexable> > Core::InfixSearch::search(const QString &req, const CancellationToken *token) const {
+    vector<shared_ptr<Indexable>> result;
+    for (const ScoredPosting &posting : intersect(match(req, token)))
+        if (!prefixSearch_->removed_[posting.id])
+            result.push_back(prefixSearch_->item(posting.id));
+    return result;
+}
+
+
+
+/** ***************************************************************************/
+vector<pair<shared_ptr<Core::Indexable>,short>> Core::InfixSearch::searchScored(const QString &req, size_t limit,
+                                                                                OfflineIndex::Cursor *cursor,
+                                                                                const CancellationToken *token) const {
+    vector<ScoredPostingList> resultsPerWord = match(req, token);
+    const uint32_t wordCount = static_cast<uint32_t>(resultsPerWord.size());
+    return prefixSearch_->rank(intersect(std::move(resultsPerWord)), wordCount, limit, cursor);
+}
@@ -0,0 +1,64 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "offlineindex.h"
+#include "postinglist.h"
+#include "suffixarray.h"
+
+namespace Core {
+
+class Indexable;
+class PrefixSearch;
+
+/**
+ * @brief The InfixSearch class
+ * An immutable overlay of a built snapshot of a prefix search that matches
+ * query words anywhere in the words of the items. The suffix array of the
+ * dictionary finds the terms containing a word, the dictionary and postings
+ * are shared with the snapshot. Matches at the start of a term rank above
+ * matches inside of it.
+ */
+class InfixSearch final
+{
+public:
+
+    explicit InfixSearch(std::shared_ptr<const PrefixSearch> prefixSearch);
+
+    /** The snapshot this overlay has been built for */
+    const std::shared_ptr<const PrefixSearch> &prefixSearch() const { return prefixSearch_; }
+
+    std::vector<std::shared_ptr<Indexable>> search(const QString &req, const CancellationToken *token) const;
+    std::vector<std::pair<std::shared_ptr<Indexable>,short>> searchScored(const QString &req, size_t limit,
+                                                                     OfflineIndex::Cursor *cursor,
+                                                                     const CancellationToken *token) const;
+
+private:
+
+    /** The scored matches of every query word, none if canceled */
+    std::vector<ScoredPostingList> match(const QString &req, const CancellationToken *token) const;
+
+    const std::shared_ptr<const PrefixSearch> prefixSearch_;
+
+    // The suffixes of the terms of the dictionary
+    SuffixArray suffixArray_;
+};
+
+}
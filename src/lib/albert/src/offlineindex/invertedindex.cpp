@@ -0,0 +1,224 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <iterator>
+#include "invertedindex.h"
+using std::pair;
+using std::vector;
+
+namespace {
+
+// Counting iterator, used to binary search over term ids
+struct TermIdIterator : public std::iterator<std::random_access_iterator_tag, uint32_t, std::ptrdiff_t> {
+    uint32_t id;
+    explicit TermIdIterator(uint32_t id) : id(id) {}
+    uint32_t operator*() const { return id; }
+    TermIdIterator &operator++() { ++id; return *this; }
+    TermIdIterator &operator--() { --id; return *this; }
+    TermIdIterator &operator+=(std::ptrdiff_t n) { id = static_cast<uint32_t>(id + n); return *this; }
+    std::ptrdiff_t operator-(const TermIdIterator &rhs) const { return static_cast<std::ptrdiff_t>(id) - rhs.id; }
+    bool operator==(const TermIdIterator &rhs) const { return id == rhs.id; }
+    bool operator!=(const TermIdIterator &rhs) const { return id != rhs.id; }
+};
+
+}
+
+
+/** ***************************************************************************/
+Core::InvertedIndex::InvertedIndex() {
+    view();
+}
+
+
+/** ***************************************************************************/
+Core::InvertedIndex::InvertedIndex(const InvertedIndex &rhs) {
+    *this = rhs;
+}
+
+
+/** ***************************************************************************/
+Core::InvertedIndex &Core::InvertedIndex::operator=(const InvertedIndex &rhs) {
+    if (this == &rhs)
+        return *this;
+    termPool_ = rhs.termPool_;
+    termOffsets_ = rhs.termOffsets_;
+    postingPool_ = rhs.postingPool_;
+    relevancePool_ = rhs.relevancePool_;
+    maxRelevances_ = rhs.maxRelevances_;
+    postingOffsets_ = rhs.postingOffsets_;
+    owner_ = rhs.owner_;
+    // Mapped pools are shared, owned ones are copied
+    if (owner_)
+        arrays_ = rhs.arrays_;
+    else
+        view();
+    return *this;
+}
+
+
+/** ***************************************************************************/
+void Core::InvertedIndex::map(const Arrays &arrays, std::shared_ptr<const void> owner) {
+    clear();
+    arrays_ = arrays;
+    owner_ = std::move(owner);
+}
+
+
+/** ***************************************************************************/
+void Core::InvertedIndex::view() {
+    arrays_.termCount = static_cast<uint32_t>(termOffsets_.size()) - 1;
+    arrays_.termPool = termPool_.data();
+    arrays_.termOffsets = termOffsets_.data();
+    arrays_.postingPool = postingPool_.data();
+    arrays_.relevancePool = relevancePool_.data();
+    arrays_.maxRelevances = maxRelevances_.data();
+    arrays_.postingOffsets = postingOffsets_.data();
+}
+
+
+/** ***************************************************************************/
+void Core::InvertedIndex::build(vector<Posting> &postings) {
+
+    clear();
+
+    // Sort by term, then by id, then by descending relevance
+    std::sort(postings.begin(), postings.end(), [](const Posting &lhs, const Posting &rhs){
+        if (lhs.term != rhs.term)
+            return lhs.term < rhs.term;
+        if (lhs.id != rhs.id)
+            return lhs.id < rhs.id;
+        return lhs.relevance > rhs.relevance;
+    });
+
+    // Drop duplicates, this keeps the most relevant posting
+    postings.erase(std::unique(postings.begin(), postings.end(), [](const Posting &lhs, const Posting &rhs){
+                       return lhs.id == rhs.id && lhs.term == rhs.term;
+                   }), postings.end());
+
+    for (vector<Posting>::const_iterator it = postings.cbegin(); it != postings.cend(); ++it) {
+
+        // Append the term to the dictionary if it is a new one
+        if (it == postings.cbegin() || (it-1)->term != it->term) {
+            if (it != postings.cbegin())
+                postingOffsets_.push_back(static_cast<uint32_t>(postingPool_.size()));
+            termPool_.insert(termPool_.end(), it->term.cbegin(), it->term.cend());
+            termOffsets_.push_back(static_cast<uint32_t>(termPool_.size()));
+            maxRelevances_.push_back(it->relevance);
+            postingPool_.push_back(it->id);
+        } else {
+            // Store the gap to the previous id
+            postingPool_.push_back(it->id - (it-1)->id);
+            maxRelevances_.back() = std::max(maxRelevances_.back(), it->relevance);
+        }
+        relevancePool_.push_back(it->relevance);
+    }
+    if (!postings.empty())
+        postingOffsets_.push_back(static_cast<uint32_t>(postingPool_.size()));
+
+    termPool_.shrink_to_fit();
+    termOffsets_.shrink_to_fit();
+    postingPool_.shrink_to_fit();
+    relevancePool_.shrink_to_fit();
+    maxRelevances_.shrink_to_fit();
+    postingOffsets_.shrink_to_fit();
+    view();
+
+    postings.clear();
+}
+
+
+/** ***************************************************************************/
+void Core::InvertedIndex::dump(vector<Posting> &postings) const {
+    vector<uint32_t> ids;
+    vector<uint16_t> relevances;
+    for (uint32_t termId = 0; termId < termCount(); ++termId) {
+        // Deep copy, the pool may not outlive the dumped postings
+        const QString raw = term(termId);
+        const QString t(raw.unicode(), raw.size());
+        ids.clear();
+        relevances.clear();
+        this->postings(termId, ids, relevances);
+        for (size_t i = 0; i < ids.size(); ++i)
+            postings.emplace_back(t, ids[i], relevances[i]);
+    }
+}
+
+
+/** ***************************************************************************/
+void Core::InvertedIndex::clear() {
+    termPool_.clear();
+    termOffsets_.assign(1, 0);
+    postingPool_.clear();
+    relevancePool_.clear();
+    maxRelevances_.clear();
+    postingOffsets_.assign(1, 0);
+    owner_.reset();
+    view();
+}
+
+
+/** ***************************************************************************/
+QString Core::InvertedIndex::term(uint32_t termId) const {
+    return QString::fromRawData(arrays_.termPool + arrays_.termOffsets[termId],
+                                static_cast<int>(arrays_.termOffsets[termId+1]-arrays_.termOffsets[termId]));
+}
+
+
+/** ***************************************************************************/
+uint32_t Core::InvertedIndex::find(const QString &t) const {
+    TermIdIterator lb = std::lower_bound(TermIdIterator(0), TermIdIterator(termCount()), t,
+                                         [this](uint32_t termId, const QString &t){ return term(termId) < t; });
+    return ( lb.id != termCount() && term(lb.id) == t ) ? lb.id : termCount();
+}
+
+
+/** ***************************************************************************/
+pair<uint32_t, uint32_t> Core::InvertedIndex::prefixRange(const QString &prefix) const {
+
+    // The first term not less than the prefix
+    TermIdIterator lb = std::lower_bound(TermIdIterator(0), TermIdIterator(termCount()), prefix,
+                                         [this](uint32_t termId, const QString &p){ return term(termId) < p; });
+
+    // Terms starting with the prefix are contiguous from here on
+    TermIdIterator ub = std::partition_point(lb, TermIdIterator(termCount()),
+                                             [this, &prefix](uint32_t termId){ return term(termId).startsWith(prefix); });
+
+    return std::make_pair(lb.id, ub.id);
+}
+
+
+/** ***************************************************************************/
+uint32_t Core::InvertedIndex::postingCount(uint32_t termId) const {
+    return arrays_.postingOffsets[termId+1] - arrays_.postingOffsets[termId];
+}
+
+
+/** ***************************************************************************/
+void Core::InvertedIndex::postings(uint32_t termId, vector<uint32_t> &ids) const {
+    uint32_t id = 0;
+    for (uint32_t i = arrays_.postingOffsets[termId]; i < arrays_.postingOffsets[termId+1]; ++i)
+        ids.push_back(id += arrays_.postingPool[i]);
+}
+
+
+/** ***************************************************************************/
+void Core::InvertedIndex::postings(uint32_t termId, vector<uint32_t> &ids, vector<uint16_t> &relevances) const {
+    postings(termId, ids);
+    relevances.insert(relevances.end(),
+                      arrays_.relevancePool + arrays_.postingOffsets[termId],
+                      arrays_.relevancePool + arrays_.postingOffsets[termId+1]);
+}
@@ -0,0 +1,129 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Core {
+
+/**
+ * @brief The InvertedIndex class
+ * A compact, immutable inverted index. The sorted terms are stored back to
+ * back in a single string pool and addressed by offsets. The postings of a
+ * term are stored as delta encoded, ascending item ids in a single pool too,
+ * accompanied by the relevance of the keyword the term stems from.
+ * Terms are identified by their rank in the sorted dictionary.
+ * The pools are plain arrays, hence the index can also view the pools of an
+ * index file in place.
+ */
+class InvertedIndex final
+{
+public:
+
+    struct Posting {
+        Posting(const QString &t, uint32_t i, uint16_t r) : term(t), id(i), relevance(r) {}
+        QString term;
+        uint32_t id;
+        uint16_t relevance;
+    };
+
+    /**
+     * @brief The pools of the index
+     * The offset arrays have termCount+1 elements, the last one is the size of
+     * the corresponding pool.
+     */
+    struct Arrays {
+        uint32_t termCount;
+        const QChar *termPool;
+        const uint32_t *termOffsets;
+        const uint32_t *postingPool;
+        const uint16_t *relevancePool;
+        const uint16_t *maxRelevances;
+        const uint32_t *postingOffsets;
+    };
+
+    InvertedIndex();
+    InvertedIndex(const InvertedIndex &rhs);
+    InvertedIndex &operator=(const InvertedIndex &rhs);
+
+    /**
+     * @brief Views the given pools instead of owning them
+     * The pools are not copied, owner keeps their memory alive as long as
+     * the index or one of its copies uses them.
+     */
+    void map(const Arrays &arrays, std::shared_ptr<const void> owner);
+
+    /** The pools of the index */
+    const Arrays &arrays() const { return arrays_; }
+
+    /**
+     * @brief Rebuilds the index from the given postings
+     * Duplicates are allowed, the highest relevance wins. The passed vector
+     * is used as scratch space.
+     */
+    void build(std::vector<Posting> &postings);
+
+    /**
+     * @brief Appends the postings of this index to postings
+     */
+    void dump(std::vector<Posting> &postings) const;
+
+    void clear();
+
+    uint32_t termCount() const { return arrays_.termCount; }
+
+    /** The term with the id termId. The returned string does not own its data. */
+    QString term(uint32_t termId) const;
+
+    /** The id of the term or termCount() if it is not in the index. */
+    uint32_t find(const QString &term) const;
+
+    /** The half open range of the ids of the terms starting with prefix. */
+    std::pair<uint32_t,uint32_t> prefixRange(const QString &prefix) const;
+
+    /** The number of items referenced by the term with the id termId. */
+    uint32_t postingCount(uint32_t termId) const;
+
+    /** The highest relevance of the postings of the term with the id termId. */
+    uint16_t maxRelevance(uint32_t termId) const { return arrays_.maxRelevances[termId]; }
+
+    /** Appends the decoded, ascending item ids of the term termId to ids. */
+    void postings(uint32_t termId, std::vector<uint32_t> &ids) const;
+
+    /** Like above but appends the relevances of the postings too. */
+    void postings(uint32_t termId, std::vector<uint32_t> &ids, std::vector<uint16_t> &relevances) const;
+
+private:
+
+    /** Points the arrays to the owned pools */
+    void view();
+
+    Arrays arrays_;
+    std::shared_ptr<const void> owner_;
+
+    std::vector<QChar> termPool_;
+    std::vector<uint32_t> termOffsets_ = {0};
+    std::vector<uint32_t> postingPool_;
+    std::vector<uint16_t> relevancePool_;
+    std::vector<uint16_t> maxRelevances_;
+    std::vector<uint32_t> postingOffsets_ = {0};
+};
+
+}
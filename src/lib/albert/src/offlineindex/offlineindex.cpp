@@ -15,87 +15,337 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
+#include <QMutex>
+#include <atomic>
 #include "offlineindex.h"
 #include "indeximpl.h"
 #include "indexable.h"
+#include "indexfile.h"
 #include "prefixsearch.h"
+#include "queryexecutor.h"
 #include "fuzzysearch.h"
+#include "infixsearch.h"
+using std::shared_ptr;
+
+namespace Core {
+
+class OfflineIndexPrivate
+{
+public:
+
+    // The published snapshot, accessed atomically only
+    shared_ptr<IndexImpl> impl;
+
+    // The copy modified by writers, guarded by writeMutex
+    shared_ptr<IndexImpl> pending;
+    bool foldDiacritics = false;
+    QMutex writeMutex;
+
+    // The overlay of the search mode over a published snapshot, accessed
+    // atomically only. It may lag behind the snapshot while the next one is
+    // being built.
+    shared_ptr<FuzzySearch> fuzzySearch;
+    shared_ptr<InfixSearch> infixSearch;
+    std::atomic<OfflineIndex::SearchMode> mode;
+    std::atomic<double> delta;
+
+    // Guards the state of the overlay build
+    QMutex overlayMutex;
+    bool building = false;
+
+    IndexImpl *writable();
+    static void buildOverlay(const shared_ptr<OfflineIndexPrivate> &d);
+};
+
+}
+
 
 
 /** ***************************************************************************/
-Core::OfflineIndex::OfflineIndex(bool fuzzy) {
-    (fuzzy) ? impl_ = new FuzzySearch() : impl_ = new PrefixSearch();
+Core::IndexImpl *Core::OfflineIndexPrivate::writable() {
+    // Copy on the first write after a commit
+    if (!pending)
+        pending.reset(std::atomic_load(&impl)->clone());
+    return pending.get();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndexPrivate::buildOverlay(const shared_ptr<OfflineIndexPrivate> &d) {
+
+    QMutexLocker lock(&d->overlayMutex);
+
+    // A running build picks up the latest snapshot and mode when it is done
+    if (d->mode == OfflineIndex::SearchMode::Prefix || d->building)
+        return;
+    d->building = true;
+
+    QueryExecutor::instance->schedule(QueryExecutor::Lane::Background, [d](){
+        forever {
+            const OfflineIndex::SearchMode mode = d->mode;
+            shared_ptr<PrefixSearch> snapshot = std::dynamic_pointer_cast<PrefixSearch>(std::atomic_load(&d->impl));
+            shared_ptr<FuzzySearch> fuzzySearch;
+            shared_ptr<InfixSearch> infixSearch;
+            if (mode == OfflineIndex::SearchMode::Fuzzy)
+                fuzzySearch = std::make_shared<FuzzySearch>(snapshot);
+            else if (mode == OfflineIndex::SearchMode::Infix)
+                infixSearch = std::make_shared<InfixSearch>(snapshot);
+
+            QMutexLocker lock(&d->overlayMutex);
+            if (d->mode == OfflineIndex::SearchMode::Prefix) {
+                d->building = false;
+                return;
+            }
+            if (d->mode != mode)
+                continue;
+            if (fuzzySearch)
+                std::atomic_store(&d->fuzzySearch, fuzzySearch);
+            if (infixSearch)
+                std::atomic_store(&d->infixSearch, infixSearch);
+            if (snapshot == std::atomic_load(&d->impl)) {
+                d->building = false;
+                return;
+            }
+        }
+    });
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::OfflineIndex(bool fuzzy) : d(new OfflineIndexPrivate) {
+    d->impl = std::make_shared<PrefixSearch>();
+    d->mode = (fuzzy) ? SearchMode::Fuzzy : SearchMode::Prefix;
+    d->delta = 1.0/3;
+    OfflineIndexPrivate::buildOverlay(d);
 }
 
 
 
 /** ***************************************************************************/
 Core::OfflineIndex::~OfflineIndex() {
-    delete impl_;
+
 }
 
 
 
 /** ***************************************************************************/
-void Core::OfflineIndex::setFuzzy(bool fuzzy) {
-    if (dynamic_cast<FuzzySearch*>(impl_)) {
-        if (fuzzy) return;
-        FuzzySearch *old = dynamic_cast<FuzzySearch*>(impl_);
-        impl_ = new PrefixSearch(*old);
-        delete old;
-    } else if (dynamic_cast<PrefixSearch*>(impl_)) {
-        if (!fuzzy) return;
-        PrefixSearch *old = dynamic_cast<PrefixSearch*>(impl_);
-        impl_ = new FuzzySearch(*old);
-        delete old;
-    } else {
-        throw; //should not happen
+void Core::OfflineIndex::setSearchMode(SearchMode mode) {
+    {
+        QMutexLocker lock(&d->overlayMutex);
+        if (d->mode == mode)
+            return;
+        d->mode = mode;
+        // Free the overlays of other modes, they are rebuilt if needed
+        if (mode != SearchMode::Fuzzy)
+            std::atomic_store(&d->fuzzySearch, shared_ptr<FuzzySearch>());
+        if (mode != SearchMode::Infix)
+            std::atomic_store(&d->infixSearch, shared_ptr<InfixSearch>());
     }
+    OfflineIndexPrivate::buildOverlay(d);
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::SearchMode Core::OfflineIndex::searchMode() const {
+    return d->mode;
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setFuzzy(bool fuzzy) {
+    setSearchMode((fuzzy) ? SearchMode::Fuzzy : SearchMode::Prefix);
 }
 
 
 
 /** ***************************************************************************/
 bool Core::OfflineIndex::fuzzy() {
-    return dynamic_cast<FuzzySearch*>(impl_) != nullptr;
+    return d->mode == SearchMode::Fuzzy;
 }
 
 
 
 /** ***************************************************************************/
-void Core::OfflineIndex::setDelta(double d) {
-    FuzzySearch* f = dynamic_cast<FuzzySearch*>(impl_);
-    if (f)
-        f->setDelta(d);
+void Core::OfflineIndex::setDelta(double delta) {
+    d->delta = delta;
 }
 
 
 
 /** ***************************************************************************/
 double Core::OfflineIndex::delta() {
-    FuzzySearch* f = dynamic_cast<FuzzySearch*>(impl_);
-    if (f)
-        return f->delta();
-    return 0;
+    return (d->mode == SearchMode::Fuzzy) ? d->delta.load() : 0;
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setFoldDiacritics(bool fold) {
+    QMutexLocker lock(&d->writeMutex);
+    if (d->foldDiacritics == fold)
+        return;
+    d->foldDiacritics = fold;
+    // The indexed words depend on the option, start over
+    d->pending = std::make_shared<PrefixSearch>(fold);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::foldDiacritics() const {
+    QMutexLocker lock(&d->writeMutex);
+    return d->foldDiacritics;
 }
 
 
 
 /** ***************************************************************************/
 void Core::OfflineIndex::add(std::shared_ptr<Core::Indexable> idxble) {
-    impl_->add(idxble);
+    QMutexLocker lock(&d->writeMutex);
+    d->writable()->add(idxble);
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::update(std::shared_ptr<Core::Indexable> idxble) {
+    QMutexLocker lock(&d->writeMutex);
+    d->writable()->update(idxble);
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::assign(const std::vector<std::shared_ptr<Core::Indexable>> &items) {
+    QMutexLocker lock(&d->writeMutex);
+    d->writable()->assign(items);
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::remove(const QString &id) {
+    QMutexLocker lock(&d->writeMutex);
+    d->writable()->remove(id);
 }
 
 
 
 /** ***************************************************************************/
 void Core::OfflineIndex::clear() {
-    impl_->clear();
+    QMutexLocker lock(&d->writeMutex);
+    // Do not copy what is going to be thrown away anyway
+    if (d->pending)
+        d->pending->clear();
+    else
+        d->pending = std::make_shared<PrefixSearch>(d->foldDiacritics);
 }
 
 
 
 /** ***************************************************************************/
-std::vector<std::shared_ptr<Core::Indexable> > Core::OfflineIndex::search(const QString &req) const {
-    return impl_->search(req);
+void Core::OfflineIndex::commit() {
+    {
+        QMutexLocker lock(&d->writeMutex);
+        if (!d->pending)
+            return;
+        // Searches must never modify a published index, build it in advance
+        d->pending->build();
+        std::atomic_store(&d->impl, d->pending);
+        d->pending.reset();
+    }
+    OfflineIndexPrivate::buildOverlay(d);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::save(const QString &path, const PayloadFunction &payload) const {
+    return std::atomic_load(&d->impl)->save(path, payload);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::load(const QString &path, ItemFactory factory) {
+    shared_ptr<const IndexFile> file = IndexFile::map(path);
+    if (!file)
+        return false;
+    {
+        QMutexLocker lock(&d->writeMutex);
+        // The words of the file are folded differently
+        if (file->foldDiacritics() != d->foldDiacritics)
+            return false;
+        d->pending.reset();
+        std::atomic_store(&d->impl, shared_ptr<IndexImpl>(std::make_shared<PrefixSearch>(file, std::move(factory))));
+    }
+    OfflineIndexPrivate::buildOverlay(d);
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::Statistics Core::OfflineIndex::statistics() const {
+    return std::atomic_load(&d->impl)->statistics();
+}
+
+
+
+/** ***************************************************************************/
+std::vector<std::shared_ptr<Core::Indexable> > Core::OfflineIndex::search(const QString &req, const CancellationToken *token) const {
+    // Pin the current snapshot for the duration of the search
+    if (d->mode == SearchMode::Fuzzy) {
+        shared_ptr<FuzzySearch> fuzzySearch = std::atomic_load(&d->fuzzySearch);
+        if (fuzzySearch)
+            return fuzzySearch->search(req, d->delta, token);
+    } else if (d->mode == SearchMode::Infix) {
+        shared_ptr<InfixSearch> infixSearch = std::atomic_load(&d->infixSearch);
+        if (infixSearch)
+            return infixSearch->search(req, token);
+    }
+    return std::atomic_load(&d->impl)->search(req, token);
+}
+
+
+
+/** ***************************************************************************/
+std::vector<std::pair<std::shared_ptr<Core::Indexable>,short>> Core::OfflineIndex::searchScored(const QString &req, size_t limit, Cursor *cursor,
+                                                                                              const CancellationToken *token) const {
+    if (d->mode == SearchMode::Fuzzy) {
+        shared_ptr<FuzzySearch> fuzzySearch = std::atomic_load(&d->fuzzySearch);
+        if (fuzzySearch)
+            return fuzzySearch->searchScored(req, d->delta, limit, cursor, token);
+    } else if (d->mode == SearchMode::Infix) {
+        shared_ptr<InfixSearch> infixSearch = std::atomic_load(&d->infixSearch);
+        if (infixSearch)
+            return infixSearch->searchScored(req, limit, cursor, token);
+    }
+    return std::atomic_load(&d->impl)->searchScored(req, limit, cursor, token);
+}
+
+
+
+/** ***************************************************************************/
+std::vector<std::pair<std::shared_ptr<Core::Indexable>,short>> Core::OfflineIndex::refineScored(const QString &req, size_t limit,
+                                                                                              shared_ptr<Refinement> &refinement,
+                                                                                              const CancellationToken *token) const {
+    if (d->mode != SearchMode::Prefix) {
+        refinement.reset();
+        return searchScored(req, limit, nullptr, token);
+    }
+
+    // The matches are meaningless for other snapshots
+    shared_ptr<IndexImpl> impl = std::atomic_load(&d->impl);
+    const Refinement *previous = (refinement && refinement->snapshot == impl) ? refinement.get() : nullptr;
+    shared_ptr<Refinement> next = std::make_shared<Refinement>();
+    next->snapshot = impl;
+    std::vector<std::pair<std::shared_ptr<Core::Indexable>,short>> results
+            = static_cast<PrefixSearch*>(impl.get())->refineScored(req, limit, previous, *next, token);
+    refinement = std::move(next);
+    return results;
 }
@@ -0,0 +1,253 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AVX2_DISPATCH
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "postinglist.h"
+using std::vector;
+
+namespace {
+
+// If one list is this many times longer than the other, gallop through it
+const size_t GALLOP_RATIO = 32;
+
+
+#if defined(AVX2_DISPATCH)
+/** ***************************************************************************/
+bool hasAvx2() {
+#if defined(__AVX2__)
+    return true;
+#else
+    // Builds target the baseline, check the processor once
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#endif
+}
+
+
+/** ***************************************************************************/
+__attribute__((target("avx2")))
+void intersectBlocksAvx2(const uint32_t *&lhs, const uint32_t *lhsEnd,
+                         const uint32_t *&rhs, const uint32_t *rhsEnd,
+                         vector<uint32_t> &result) {
+    // Like the SSE2 merge below, but with blocks of eight ids and seven
+    // rotations of the other block
+    const __m256i rotation = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    while (lhsEnd - lhs >= 8 && rhsEnd - rhs >= 8) {
+        const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs));
+        __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs));
+        __m256i cmp = _mm256_cmpeq_epi32(l, r);
+        for (int i = 1; i < 8; ++i) {
+            r = _mm256_permutevar8x32_epi32(r, rotation);
+            cmp = _mm256_or_si256(cmp, _mm256_cmpeq_epi32(l, r));
+        }
+        for (int mask = _mm256_movemask_ps(_mm256_castsi256_ps(cmp)); mask; mask &= mask - 1)
+            result.push_back(lhs[__builtin_ctz(static_cast<unsigned>(mask))]);
+
+        const uint32_t lhsMax = lhs[7];
+        const uint32_t rhsMax = rhs[7];
+        if (lhsMax <= rhsMax)
+            lhs += 8;
+        if (rhsMax <= lhsMax)
+            rhs += 8;
+    }
+}
+#endif
+
+
+/** ***************************************************************************/
+void intersectGalloping(const uint32_t *small, const uint32_t *smallEnd,
+                        const uint32_t *large, const uint32_t *largeEnd,
+                        vector<uint32_t> &result) {
+    for (; small != smallEnd && large != largeEnd; ++small) {
+
+        // Exponentially increase the step until the bound passes the id
+        size_t step = 1;
+        while (large + step < largeEnd && large[step] < *small)
+            step <<= 1;
+
+        // Binary search the bracketed range
+        large = std::lower_bound(large + (step >> 1), std::min(large + step + 1, largeEnd), *small);
+        if (large != largeEnd && *large == *small)
+            result.push_back(*large++);
+    }
+}
+
+
+/** ***************************************************************************/
+void intersectMerge(const uint32_t *lhs, const uint32_t *lhsEnd,
+                    const uint32_t *rhs, const uint32_t *rhsEnd,
+                    vector<uint32_t> &result) {
+
+#if defined(AVX2_DISPATCH)
+    if (hasAvx2())
+        intersectBlocksAvx2(lhs, lhsEnd, rhs, rhsEnd, result);
+#endif
+
+#if defined(__SSE2__)
+    /*
+     * Compare blocks of four ids with all four rotations of the other block.
+     * Since both lists are strictly ascending every id matches at most once.
+     * The block with the smaller last id can not match anything in the
+     * following blocks of the other list, so advance it.
+     */
+    while (lhsEnd - lhs >= 4 && rhsEnd - rhs >= 4) {
+        const __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs));
+        const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs));
+        const __m128i cmp = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi32(l, r),
+                                 _mm_cmpeq_epi32(l, _mm_shuffle_epi32(r, _MM_SHUFFLE(0,3,2,1)))),
+                    _mm_or_si128(_mm_cmpeq_epi32(l, _mm_shuffle_epi32(r, _MM_SHUFFLE(1,0,3,2))),
+                                 _mm_cmpeq_epi32(l, _mm_shuffle_epi32(r, _MM_SHUFFLE(2,1,0,3)))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(cmp));
+        for (int i = 0; mask; ++i, mask >>= 1)
+            if (mask & 1)
+                result.push_back(lhs[i]);
+
+        const uint32_t lhsMax = lhs[3];
+        const uint32_t rhsMax = rhs[3];
+        if (lhsMax <= rhsMax)
+            lhs += 4;
+        if (rhsMax <= lhsMax)
+            rhs += 4;
+    }
+#endif
+
+    // Plain merge for the remainder
+    while (lhs != lhsEnd && rhs != rhsEnd) {
+        if (*lhs < *rhs)
+            ++lhs;
+        else if (*rhs < *lhs)
+            ++rhs;
+        else {
+            result.push_back(*lhs);
+            ++lhs;
+            ++rhs;
+        }
+    }
+}
+
+}
+
+
+/** ***************************************************************************/
+void Core::makePostingList(vector<uint32_t> &ids, uint32_t universe) {
+
+    // Sorting is cheaper for sparse lists
+    if (ids.size() < universe / 32) {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return;
+    }
+
+    // Dense lists are faster deduplicated by a bitmap
+    vector<uint64_t> bitmap((static_cast<size_t>(universe) + 63) / 64, 0);
+    for (uint32_t id : ids)
+        bitmap[id >> 6] |= uint64_t(1) << (id & 63);
+
+    ids.clear();
+    for (size_t word = 0; word < bitmap.size(); ++word) {
+        uint32_t id = static_cast<uint32_t>(word * 64);
+        for (uint64_t bits = bitmap[word]; bits; bits >>= 1, ++id)
+            if (bits & 1)
+                ids.push_back(id);
+    }
+}
+
+
+/** ***************************************************************************/
+void Core::intersect(const PostingList &lhs, const PostingList &rhs, PostingList &result) {
+
+    result.clear();
+
+    const PostingList &small = (lhs.size() < rhs.size()) ? lhs : rhs;
+    const PostingList &large = (lhs.size() < rhs.size()) ? rhs : lhs;
+
+    if (small.empty())
+        return;
+
+    result.reserve(small.size());
+
+    if (small.size() * GALLOP_RATIO < large.size())
+        intersectGalloping(small.data(), small.data() + small.size(),
+                           large.data(), large.data() + large.size(), result);
+    else
+        intersectMerge(small.data(), small.data() + small.size(),
+                       large.data(), large.data() + large.size(), result);
+}
+
+
+/** ***************************************************************************/
+void Core::makeScoredPostingList(ScoredPostingList &postings) {
+    std::sort(postings.begin(), postings.end(), [](const ScoredPosting &lhs, const ScoredPosting &rhs){
+        return lhs.id < rhs.id || (lhs.id == rhs.id && lhs.score > rhs.score);
+    });
+    postings.erase(std::unique(postings.begin(), postings.end(), [](const ScoredPosting &lhs, const ScoredPosting &rhs){
+                       return lhs.id == rhs.id;
+                   }), postings.end());
+}
+
+
+/** ***************************************************************************/
+void Core::intersect(const ScoredPostingList &lhs, const ScoredPostingList &rhs, ScoredPostingList &result) {
+
+    result.clear();
+
+    const ScoredPostingList &small = (lhs.size() < rhs.size()) ? lhs : rhs;
+    const ScoredPostingList &large = (lhs.size() < rhs.size()) ? rhs : lhs;
+    const bool gallop = small.size() * GALLOP_RATIO < large.size();
+
+    ScoredPostingList::const_iterator l = large.cbegin();
+    for (ScoredPostingList::const_iterator s = small.cbegin(); s != small.cend() && l != large.cend(); ++s) {
+        if (gallop)
+            l = std::lower_bound(l, large.cend(), s->id,
+                                 [](const ScoredPosting &p, uint32_t id){ return p.id < id; });
+        else
+            while (l != large.cend() && l->id < s->id)
+                ++l;
+        if (l != large.cend() && l->id == s->id) {
+            result.push_back({s->id, s->score + l->score});
+            ++l;
+        }
+    }
+}
+
+
+/** ***************************************************************************/
+Core::ScoredPostingList Core::intersect(vector<ScoredPostingList> &&lists) {
+
+    // Start with the smallest list, this keeps the intermediate results small
+    std::sort(lists.begin(), lists.end(),
+              [](const ScoredPostingList &lhs, const ScoredPostingList &rhs){ return lhs.size() < rhs.size(); });
+
+    ScoredPostingList result, intersection;
+    for (ScoredPostingList &list : lists) {
+        if (&list == &lists.front())
+            result.swap(list);
+        else {
+            intersect(result, list, intersection);
+            result.swap(intersection);
+        }
+        if (result.empty())
+            break;
+    }
+    return result;
+}
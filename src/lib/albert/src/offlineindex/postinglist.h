@@ -0,0 +1,79 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace Core {
+
+/**
+ * A posting list is a strictly ascending list of item ids
+ */
+typedef std::vector<uint32_t> PostingList;
+
+/**
+ * @brief Turns an unordered list of ids into a posting list
+ * @param ids The ids, may contain duplicates
+ * @param universe An upper bound of the ids, used to choose a bitmap over
+ * sorting for dense lists
+ */
+void makePostingList(std::vector<uint32_t> &ids, uint32_t universe);
+
+/**
+ * @brief Intersects two posting lists
+ * Uses galloping search if the lengths are skewed, else a merge vectorized
+ * with AVX2 if the processor supports it, with SSE2 if the build targets it
+ * and a plain merge for the remainder.
+ * @param result Cleared and filled with the ids common to both lists
+ */
+void intersect(const PostingList &lhs, const PostingList &rhs, PostingList &result);
+
+/**
+ * An item id accompanied by the score of its match
+ */
+struct ScoredPosting {
+    uint32_t id;
+    float score;
+};
+
+/**
+ * A scored posting list is a list of scored postings with strictly ascending
+ * ids
+ */
+typedef std::vector<ScoredPosting> ScoredPostingList;
+
+/**
+ * @brief Turns an unordered list of scored postings into a scored posting list
+ * Of multiple postings with the same id the one with the best score is kept.
+ */
+void makeScoredPostingList(ScoredPostingList &postings);
+
+/**
+ * @brief Intersects two scored posting lists
+ * @param result Cleared and filled with the postings common to both lists.
+ * The scores of common postings are summed.
+ */
+void intersect(const ScoredPostingList &lhs, const ScoredPostingList &rhs, ScoredPostingList &result);
+
+/**
+ * @brief Intersects a set of scored posting lists, smallest first
+ * @param lists The lists, used as scratch space
+ * @return The postings common to all lists, the scores summed
+ */
+ScoredPostingList intersect(std::vector<ScoredPostingList> &&lists);
+
+}
@@ -0,0 +1,129 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <iterator>
+#include "prefixeditdistance.h"
+using std::pair;
+using std::vector;
+
+
+/** ***************************************************************************/
+Core::PrefixEditDistance::PrefixEditDistance(const QString &prefix) : prefix_(prefix) {
+    if (prefix_.size() > 64)
+        return;
+    std::fill(std::begin(asciiPeq_), std::end(asciiPeq_), 0);
+    for (int i = 0; i < prefix_.size(); ++i) {
+        const ushort c = prefix_[i].unicode();
+        if (c < 128)
+            asciiPeq_[c] |= uint64_t(1) << i;
+        else {
+            auto it = std::find_if(otherPeq_.begin(), otherPeq_.end(),
+                                   [c](const pair<ushort,uint64_t> &p){ return p.first == c; });
+            if (it == otherPeq_.end())
+                otherPeq_.emplace_back(c, uint64_t(1) << i);
+            else
+                it->second |= uint64_t(1) << i;
+        }
+    }
+}
+
+
+/** ***************************************************************************/
+uint Core::PrefixEditDistance::operator()(const QString &str, uint delta) const {
+    const uint n = static_cast<uint>(prefix_.size());
+    const uint m = std::min(n + delta, static_cast<uint>(str.size()));
+    return (n <= 64) ? bitParallel(str, m, delta) : dynamic(str, m);
+}
+
+
+/** ***************************************************************************/
+uint64_t Core::PrefixEditDistance::peq(ushort c) const {
+    if (c < 128)
+        return asciiPeq_[c];
+    for (const pair<ushort,uint64_t> &p : otherPeq_)
+        if (p.first == c)
+            return p.second;
+    return 0;
+}
+
+
+/** ***************************************************************************/
+uint Core::PrefixEditDistance::bitParallel(const QString &str, uint m, uint delta) const {
+    const uint n = static_cast<uint>(prefix_.size());
+    if (n == 0)
+        return 0;
+
+    // Vertical deltas of the current column, all +1 for the first column
+    const uint64_t high = uint64_t(1) << (n - 1);
+    uint64_t vp = (n == 64) ? ~uint64_t(0) : (high << 1) - 1;
+    uint64_t vn = 0;
+
+    // The score is the last cell of the column, the distance of the
+    // prefix to the first j characters of str
+    uint score = n;
+    uint result = n;
+    for (uint j = 0; j < m; ++j) {
+        const uint64_t eq = peq(str[j].unicode());
+        const uint64_t xv = eq | vn;
+        const uint64_t xh = (((eq & vp) + vp) ^ vp) | eq;
+        uint64_t ph = vn | ~(xh | vp);
+        uint64_t mh = vp & xh;
+        if (ph & high)
+            ++score;
+        else if (mh & high)
+            --score;
+        // The first row increases by one per column (global alignment)
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        vp = mh | ~(xv | ph);
+        vn = ph & xv;
+
+        result = std::min(result, score);
+
+        // The score decreases by at most one per column
+        if (result == 0 || (result > delta && score > delta + (m - j - 1)))
+            break;
+    }
+    return result;
+}
+
+
+/** ***************************************************************************/
+uint Core::PrefixEditDistance::dynamic(const QString &str, uint m) const {
+    const uint n = static_cast<uint>(prefix_.size());
+
+    // Column j holds the distances of the prefixes of the prefix to the
+    // first j characters of str
+    vector<uint> column(n + 1);
+    for (uint i = 0; i <= n; ++i)
+        column[i] = i;
+
+    uint result = n;
+    for (uint j = 1; j <= m; ++j) {
+        uint diagonal = column[0];
+        column[0] = j;
+        for (uint i = 1; i <= n; ++i) {
+            const uint left = column[i];
+            column[i] = std::min(std::min(left + 1, column[i-1] + 1),
+                                 diagonal + (prefix_[i-1] == str[j-1] ? 0 : 1));
+            diagonal = left;
+        }
+        result = std::min(result, column[n]);
+    }
+    return result;
+}
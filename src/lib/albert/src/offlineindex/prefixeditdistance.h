@@ -0,0 +1,58 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Core {
+
+/**
+ * @brief Computes the prefix edit distance of a fixed prefix to strings
+ * The prefix edit distance is the minimal edit distance of the prefix to any
+ * prefix of the string. Prefixes of up to 64 characters use the bit-parallel
+ * algorithm of Myers (in the formulation of Hyyrö) that computes a column of
+ * the dynamic programming matrix per machine word operation. Longer prefixes
+ * fall back to a plain column wise dynamic program.
+ */
+class PrefixEditDistance final
+{
+public:
+
+    explicit PrefixEditDistance(const QString &prefix);
+
+    /**
+     * @brief The prefix edit distance to str
+     * Only the first |prefix|+delta characters of str are considered. The
+     * result is exact up to delta, larger results just mean "above delta".
+     */
+    uint operator()(const QString &str, uint delta) const;
+
+private:
+
+    uint64_t peq(ushort c) const;
+    uint bitParallel(const QString &str, uint m, uint delta) const;
+    uint dynamic(const QString &str, uint m) const;
+
+    const QString prefix_;
+    uint64_t asciiPeq_[128];
+    std::vector<std::pair<ushort,uint64_t>> otherPeq_;
+};
+
+}
@@ -14,29 +14,112 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <QRegularExpression>
+#include <QSet>
+#include <QStringList>
 #include <algorithm>
+#include <climits>
+#include <functional>
+#include <limits>
+#include <numeric>
 #include "indeximpl.h"
 #include "indexable.h"
+#include "indexfile.h"
+#include "postinglist.h"
 #include "prefixsearch.h"
-using std::map;
-using std::set;
+#include "tokenizer.h"
+using std::pair;
 using std::shared_ptr;
 using std::vector;
 
+namespace {
+
+struct Candidate {
+    float score;
+    uint32_t id;
+};
+
+/** Orders by descending score, ties by ascending id */
+bool better(const Candidate &lhs, const Candidate &rhs) {
+    return lhs.score > rhs.score || (lhs.score == rhs.score && lhs.id < rhs.id);
+}
+
+const uint32_t noRow = UINT32_MAX;
+
+// Matches of derived tokens are worth less than direct matches
+const float DERIVED_WEIGHT = 0.5f;
+
+/** Merges the staged postings into the index */
+void merge(Core::InvertedIndex &index, vector<Core::InvertedIndex::Posting> &stagedPostings) {
+    if (stagedPostings.empty())
+        return;
+    index.dump(stagedPostings);
+    index.build(stagedPostings);
+    stagedPostings.shrink_to_fit();
+}
+
+/** Renumbers the postings of the index and drops the ones of removed items */
+void renumber(Core::InvertedIndex &index, vector<Core::InvertedIndex::Posting> &stagedPostings,
+              const vector<uint32_t> &newIds) {
+    index.dump(stagedPostings);
+    stagedPostings.erase(std::remove_if(stagedPostings.begin(), stagedPostings.end(),
+                                        [&newIds](const Core::InvertedIndex::Posting &posting){
+                                            return newIds[posting.id] == UINT32_MAX;
+                                        }),
+                         stagedPostings.end());
+    for (Core::InvertedIndex::Posting &posting : stagedPostings)
+        posting.id = newIds[posting.id];
+    index.build(stagedPostings);
+}
+
+}
+
 
 
 /** ***************************************************************************/
-Core::PrefixSearch::PrefixSearch(){
+Core::PrefixSearch::PrefixSearch(bool fold) : fold_(fold) {
 
 }
 
 
 
 /** ***************************************************************************/
-Core::PrefixSearch::PrefixSearch(const Core::PrefixSearch &rhs) {
-    index_ = rhs.index_;
+Core::PrefixSearch::PrefixSearch(const Core::PrefixSearch &rhs) : fold_(rhs.fold_) {
+    QMutexLocker lock(&rhs.buildMutex_);
+    {
+        // Searches may create items concurrently
+        QMutexLocker itemLock(&rhs.itemMutex_);
+        index_ = rhs.index_;
+    }
+    removed_ = rhs.removed_;
+    wordCounts_ = rhs.wordCounts_;
+    keywordHashes_ = rhs.keywordHashes_;
+    ids_ = rhs.ids_;
+    idsLoaded_ = rhs.idsLoaded_;
+    removedCount_ = rhs.removedCount_;
     invertedIndex_ = rhs.invertedIndex_;
+    stagedPostings_ = rhs.stagedPostings_;
+    derivedIndex_ = rhs.derivedIndex_;
+    stagedDerivedPostings_ = rhs.stagedDerivedPostings_;
+    file_ = rhs.file_;
+    rows_ = rhs.rows_;
+    factory_ = rhs.factory_;
+}
+
+
+
+/** ***************************************************************************/
+Core::PrefixSearch::PrefixSearch(shared_ptr<const IndexFile> file, OfflineIndex::ItemFactory factory)
+    : idsLoaded_(false), file_(file), factory_(std::move(factory)), fold_(file->foldDiacritics()) {
+    // Copy the small per item arrays, view the pools in place
+    const uint32_t itemCount = file->itemCount();
+    index_.resize(itemCount);
+    removed_.assign(itemCount, false);
+    wordCounts_.assign(file->wordCounts(), file->wordCounts() + itemCount);
+    keywordHashes_.assign(file->keywordHashes(), file->keywordHashes() + itemCount);
+    rows_.resize(itemCount);
+    std::iota(rows_.begin(), rows_.end(), 0);
+    invertedIndex_.map(file->arrays(), file);
+    derivedIndex_.map(file->derivedArrays(), file);
 }
 
 
@@ -46,83 +129,732 @@ Core::PrefixSearch::~PrefixSearch(){}
 
 
 
+/** ***************************************************************************/
+Core::IndexImpl *Core::PrefixSearch::clone() const {
+    return new PrefixSearch(*this);
+}
+
+
+
 /** ***************************************************************************/
 void Core::PrefixSearch::add(shared_ptr<Core::Indexable> indexable) {
+    // An item with the same id would be orphaned, replace it
+    update(indexable);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::update(shared_ptr<Core::Indexable> indexable) {
+
+    const vector<Indexable::WeightedKeyword> indexKeywords = indexable->indexKeywords();
+    const uint keywordHash = hash(indexKeywords);
+
+    QMutexLocker lock(&buildMutex_);
+    loadIds();
+
+    QHash<QString,uint32_t>::const_iterator it = ids_.constFind(indexable->id());
+    if (it != ids_.cend()) {
+
+        // The postings are still valid if the keywords did not change, just
+        // swap the item then. The hash rules out most changes, the keywords of
+        // an item in memory confirm the rest. Items still in the file are not
+        // created for that, their word count confirms the rest. An item
+        // modified in place can not be compared and is reindexed.
+        const uint32_t id = it.value();
+        if (keywordHashes_[id] == keywordHash) {
+            const shared_ptr<Indexable> &previous = index_[id];
+            if (previous ? previous != indexable && equal(previous->indexKeywords(), indexKeywords)
+                         : wordCounts_[id] == wordCount(indexKeywords)) {
+                index_[id] = indexable;
+                return;
+            }
+        }
+
+        erase(id);
+    }
+
+    insert(indexable, indexKeywords, keywordHash);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::assign(const vector<shared_ptr<Indexable>> &indexables) {
+
+    QSet<QString> ids;
+    ids.reserve(static_cast<int>(indexables.size()));
+    for (const shared_ptr<Indexable> &indexable : indexables)
+        ids.insert(indexable->id());
+
+    // Remove the items that are gone first, their slots may be compacted away
+    {
+        QMutexLocker lock(&buildMutex_);
+        loadIds();
+        QStringList removedIds;
+        for (QHash<QString,uint32_t>::const_iterator it = ids_.cbegin(); it != ids_.cend(); ++it)
+            if (!ids.contains(it.key()))
+                removedIds.append(it.key());
+        for (const QString &id : removedIds) {
+            // Compactions renumber the items
+            QHash<QString,uint32_t>::const_iterator it = ids_.constFind(id);
+            if (it != ids_.cend())
+                erase(it.value());
+        }
+    }
+
+    for (const shared_ptr<Indexable> &indexable : indexables)
+        update(indexable);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::remove(const QString &id) {
+    QMutexLocker lock(&buildMutex_);
+    loadIds();
+    QHash<QString,uint32_t>::const_iterator it = ids_.constFind(id);
+    if (it != ids_.cend())
+        erase(it.value());
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::insert(shared_ptr<Core::Indexable> indexable,
+                                const vector<Indexable::WeightedKeyword> &indexKeywords,
+                                uint keywordHash) {
 
     // Add indexable to the index
     index_.push_back(indexable);
+    removed_.push_back(false);
+    if (file_)
+        rows_.push_back(noRow);
     uint id = static_cast<uint>(index_.size()-1);
+    ids_.insert(indexable->id(), id);
+    keywordHashes_.push_back(keywordHash);
 
-    vector<Indexable::WeightedKeyword> indexKeywords = indexable->indexKeywords();
+    QString word;
+    vector<QString> derivedTokens;
+    uint32_t wordCount = 0;
     for (const auto &wkw : indexKeywords) {
-        // Build an inverted index
-        QStringList words = wkw.keyword.split(QRegularExpression(SEPARATOR_REGEX), QString::SkipEmptyParts);
-        for (const QString &w : words) {
-            invertedIndex_[w.toLower()].insert(id);
+        const uint16_t relevance = static_cast<uint16_t>(std::min<uint32_t>(wkw.relevance, USHRT_MAX));
+        Tokenizer tokenizer(wkw.keyword, fold_);
+        while (tokenizer.next(word)) {
+            // Stage the posting for the inverted index
+            stagedPostings_.emplace_back(word, id, relevance);
+            ++wordCount;
         }
+        derivedTokens.clear();
+        Tokenizer::derive(wkw.keyword, derivedTokens, fold_);
+        for (const QString &token : derivedTokens)
+            stagedDerivedPostings_.emplace_back(token, id, relevance);
+    }
+    wordCounts_.push_back(static_cast<uint16_t>(std::min<uint32_t>(wordCount, USHRT_MAX)));
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::erase(uint32_t id) {
+
+    // Leave a tombstone, searches skip it
+    ids_.remove(itemId(id));
+    index_[id].reset();
+    removed_[id] = true;
+    ++removedCount_;
+
+    // Compact if a quarter of the items is dead, this amortizes the rebuild
+    if (removedCount_ >= 64 && removedCount_ * 4 >= index_.size())
+        compact();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::PrefixSearch::equal(const vector<Indexable::WeightedKeyword> &lhs,
+                               const vector<Indexable::WeightedKeyword> &rhs) {
+    return lhs.size() == rhs.size()
+            && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+                          [](const Indexable::WeightedKeyword &l, const Indexable::WeightedKeyword &r){
+                              return l.relevance == r.relevance && l.keyword == r.keyword;
+                          });
+}
+
+
+
+/** ***************************************************************************/
+uint Core::PrefixSearch::hash(const vector<Indexable::WeightedKeyword> &indexKeywords) {
+    uint seed = 0;
+    for (const auto &wkw : indexKeywords)
+        seed = qHash(wkw.keyword, qHash(wkw.relevance, seed));
+    return seed;
+}
+
+
+
+/** ***************************************************************************/
+uint16_t Core::PrefixSearch::wordCount(const vector<Indexable::WeightedKeyword> &indexKeywords) const {
+    QString word;
+    uint32_t wordCount = 0;
+    for (const auto &wkw : indexKeywords) {
+        Tokenizer tokenizer(wkw.keyword, fold_);
+        while (tokenizer.next(word))
+            ++wordCount;
     }
+    return static_cast<uint16_t>(std::min<uint32_t>(wordCount, USHRT_MAX));
+}
+
+
+
+/** ***************************************************************************/
+shared_ptr<Core::Indexable> Core::PrefixSearch::item(uint32_t id) const {
+    if (!file_)
+        return index_[id];
+    QMutexLocker lock(&itemMutex_);
+    if (!index_[id])
+        index_[id] = factory_(file_->id(rows_[id]), file_->payload(rows_[id]));
+    return index_[id];
+}
+
+
+
+/** ***************************************************************************/
+QString Core::PrefixSearch::itemId(uint32_t id) const {
+    return (index_[id]) ? index_[id]->id() : file_->id(rows_[id]);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::loadIds() {
+    if (idsLoaded_)
+        return;
+    ids_.reserve(static_cast<int>(index_.size()));
+    for (uint32_t id = 0; id < index_.size(); ++id)
+        if (!removed_[id])
+            ids_.insert(itemId(id), id);
+    idsLoaded_ = true;
 }
 
 
 
 /** ***************************************************************************/
 void Core::PrefixSearch::clear() {
+    QMutexLocker lock(&buildMutex_);
+    stagedPostings_.clear();
     invertedIndex_.clear();
+    stagedDerivedPostings_.clear();
+    derivedIndex_.clear();
+    wordCounts_.clear();
+    keywordHashes_.clear();
+    ids_.clear();
+    idsLoaded_ = true;
+    removedCount_ = 0;
     index_.clear();
+    removed_.clear();
+    file_.reset();
+    rows_.clear();
+    factory_ = nullptr;
 }
 
 
 
 /** ***************************************************************************/
-vector<shared_ptr<Core::Indexable> > Core::PrefixSearch::search(const QString &req) const {
+bool Core::PrefixSearch::save(const QString &path, const OfflineIndex::PayloadFunction &payload) const {
 
+    build();
 
-    // Split the query into words W
-    QStringList words = req.split(QRegularExpression(SEPARATOR_REGEX), QString::SkipEmptyParts);
+    // Files are dense, save a compacted copy
+    if (removedCount_ != 0) {
+        PrefixSearch compacted(*this);
+        compacted.compact();
+        return compacted.save(path, payload);
+    }
 
-    // Skip if there arent any // CONSTRAINT (2): |W| > 0
-    if (words.empty())
-        return vector<shared_ptr<Indexable>>();
+    vector<shared_ptr<Indexable>> items;
+    {
+        QMutexLocker lock(&itemMutex_);
+        items = index_;
+    }
 
-    set<uint> resultsSet;
-    QStringList::iterator wordIterator = words.begin();
+    // Rows of items not created yet are copied from the file
+    vector<IndexFile::Row> rows;
+    rows.reserve(items.size());
+    for (uint32_t id = 0; id < items.size(); ++id) {
+        if (items[id])
+            rows.push_back({items[id]->id(), payload(*items[id]), wordCounts_[id], keywordHashes_[id]});
+        else
+            rows.push_back({file_->id(rows_[id]), file_->payload(rows_[id]), wordCounts_[id], keywordHashes_[id]});
+    }
 
-    // Make lower for case insensitivity
-    QString word = wordIterator++->toLower();
+    return IndexFile::write(path, invertedIndex_, derivedIndex_, rows, fold_);
+}
 
-    // Get a word mapping once before going to handle intersections
-    for (std::map<QString,std::set<uint>>::const_iterator lb = invertedIndex_.lower_bound(word);
-         lb != invertedIndex_.cend() && lb->first.startsWith(word); ++lb)
-        resultsSet.insert(lb->second.begin(), lb->second.end());
 
 
-    for (;wordIterator != words.end(); ++wordIterator) {
+/** ***************************************************************************/
+void Core::PrefixSearch::compact() {
+
+    // Map the ids of the remaining items to dense ids
+    vector<uint32_t> newIds(index_.size(), UINT32_MAX);
+    uint32_t count = 0;
+    for (uint32_t id = 0; id < index_.size(); ++id) {
+        if (removed_[id])
+            continue;
+        newIds[id] = count;
+        index_[count] = std::move(index_[id]);
+        if (file_)
+            rows_[count] = rows_[id];
+        wordCounts_[count] = wordCounts_[id];
+        keywordHashes_[count] = keywordHashes_[id];
+        ++count;
+    }
+    index_.resize(count);
+    removed_.assign(count, false);
+    if (file_)
+        rows_.resize(count);
+    wordCounts_.resize(count);
+    keywordHashes_.resize(count);
+    for (QHash<QString,uint32_t>::iterator it = ids_.begin(); it != ids_.end(); ++it)
+        it.value() = newIds[it.value()];
+
+    // Renumber the postings and drop the ones of removed items
+    renumber(invertedIndex_, stagedPostings_, newIds);
+    renumber(derivedIndex_, stagedDerivedPostings_, newIds);
+    removedCount_ = 0;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::build() const {
+
+    QMutexLocker lock(&buildMutex_);
+
+    if (stagedPostings_.empty() && stagedDerivedPostings_.empty())
+        return;
+
+    // Merge the existing postings with the staged ones and rebuild
+    merge(invertedIndex_, stagedPostings_);
+    merge(derivedIndex_, stagedDerivedPostings_);
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::Statistics Core::PrefixSearch::statistics() const {
+    build();
+    const InvertedIndex::Arrays &direct = invertedIndex_.arrays();
+    const InvertedIndex::Arrays &derived = derivedIndex_.arrays();
+    OfflineIndex::Statistics statistics;
+    statistics.items = static_cast<uint32_t>(index_.size()) - removedCount_;
+    statistics.terms = direct.termCount;
+    statistics.postings = direct.postingOffsets[direct.termCount];
+    statistics.derivedTerms = derived.termCount;
+    statistics.derivedPostings = derived.postingOffsets[derived.termCount];
+    return statistics;
+}
+
+
+
+/** ***************************************************************************/
+vector<shared_ptr<Core::Indexable> > Core::PrefixSearch::search(const QString &req, const CancellationToken *token) const {
+
+    build();
+
+    // Split the query into words W, get the range of terms starting with
+    // w ∈ W and estimate the size of U_w
+    struct WordRange { std::pair<uint32_t,uint32_t> terms; std::pair<uint32_t,uint32_t> derivedTerms; uint32_t estimate; };
+    vector<WordRange> ranges;
+    Tokenizer tokenizer(req, fold_);
+    QString word;
+    while (tokenizer.next(word)) {
+        WordRange r;
+        r.terms = invertedIndex_.prefixRange(word);
+        r.derivedTerms = derivedIndex_.prefixRange(word);
+        r.estimate = 0;
+        for (uint32_t termId = r.terms.first; termId != r.terms.second; ++termId)
+            r.estimate += invertedIndex_.postingCount(termId);
+        for (uint32_t termId = r.derivedTerms.first; termId != r.derivedTerms.second; ++termId)
+            r.estimate += derivedIndex_.postingCount(termId);
+        ranges.push_back(r);
+    }
+
+    // Skip if there arent any // CONSTRAINT (2): |W| > 0
+    if (ranges.empty())
+        return vector<shared_ptr<Indexable>>();
+
+    // Process the rarest word first, this keeps the intermediate results small
+    std::sort(ranges.begin(), ranges.end(),
+              [](const WordRange &lhs, const WordRange &rhs){ return lhs.estimate < rhs.estimate; });
 
-        // Make lower for case insensitivity
-        word = wordIterator->toLower();
+    PostingList results, wordMappingsUnion, intersection;
+    for (vector<WordRange>::const_iterator it = ranges.cbegin(); it != ranges.cend(); ++it) {
+
+        if (isCanceled(token))
+            return vector<shared_ptr<Indexable>>();
 
         // Unite the sets that are mapped by words that begin with word
         // w ∈ W. This set is called U_w
-        set<uint> wordMappingsUnion;
-        for (std::map<QString,std::set<uint>>::const_iterator lb = invertedIndex_.lower_bound(word);
-             lb != invertedIndex_.cend() && lb->first.startsWith(word); ++lb)
-            wordMappingsUnion.insert(lb->second.begin(), lb->second.end());
-
+        PostingList &target = (it == ranges.cbegin()) ? results : wordMappingsUnion;
+        target.clear();
+        target.reserve(it->estimate);
+        for (uint32_t termId = it->terms.first; termId != it->terms.second; ++termId)
+            invertedIndex_.postings(termId, target);
+        for (uint32_t termId = it->derivedTerms.first; termId != it->derivedTerms.second; ++termId)
+            derivedIndex_.postings(termId, target);
+        makePostingList(target, static_cast<uint32_t>(index_.size()));
 
         // Intersect all sets U_w with the results
-        set<uint> intersection;
-        std::set_intersection(resultsSet.begin(), resultsSet.end(),
-                              wordMappingsUnion.begin(), wordMappingsUnion.end(),
-                              std::inserter(intersection, intersection.begin()));
-        resultsSet = std::move(intersection);
+        if (it != ranges.cbegin()) {
+            intersect(results, wordMappingsUnion, intersection);
+            results.swap(intersection);
+        }
+
+        // Nothing left to intersect
+        if (results.empty())
+            break;
     }
 
     // Convert to a std::vector
+    vector<shared_ptr<Indexable>> resultsVector;
+    resultsVector.reserve(results.size());
+    for (uint32_t id : results)
+        if (!removed_[id])
+            resultsVector.emplace_back(item(id));
+    return resultsVector;
+}
 
 
 
-    vector<shared_ptr<Indexable>> resultsVector;
-    for (uint id : resultsSet)
-        resultsVector.emplace_back(index_.at(id));
-    return resultsVector;
+/** ***************************************************************************/
+vector<pair<shared_ptr<Core::Indexable>,short>> Core::PrefixSearch::searchScored(const QString &req, size_t limit,
+                                                                                 OfflineIndex::Cursor *cursor,
+                                                                                 const CancellationToken *token) const {
+    return searchScored(req, limit, cursor, nullptr, nullptr, token);
+}
+
+
+
+/** ***************************************************************************/
+vector<pair<shared_ptr<Core::Indexable>,short>> Core::PrefixSearch::refineScored(const QString &req, size_t limit,
+                                                                                 const OfflineIndex::Refinement *previous,
+                                                                                 OfflineIndex::Refinement &next,
+                                                                                 const CancellationToken *token) const {
+    return searchScored(req, limit, nullptr, previous, &next, token);
+}
+
+
+
+/** ***************************************************************************/
+vector<pair<shared_ptr<Core::Indexable>,short>> Core::PrefixSearch::searchScored(const QString &req, size_t limit,
+                                                                                 OfflineIndex::Cursor *cursor,
+                                                                                 const OfflineIndex::Refinement *previous,
+                                                                                 OfflineIndex::Refinement *next,
+                                                                                 const CancellationToken *token) const {
+
+    if (limit == 0 || (cursor && cursor->atEnd))
+        return vector<pair<shared_ptr<Indexable>,short>>();
+
+    build();
+
+    // Split the query into words W, get the range of terms starting with
+    // w ∈ W and estimate the size of U_w
+    struct WordRange { std::pair<uint32_t,uint32_t> terms; std::pair<uint32_t,uint32_t> derivedTerms; uint32_t estimate; int length; QString word; };
+    vector<WordRange> ranges;
+    vector<QString> query;
+    Tokenizer tokenizer(req, fold_);
+    QString word;
+    while (tokenizer.next(word)) {
+        query.push_back(word);
+        WordRange r;
+        r.terms = invertedIndex_.prefixRange(word);
+        r.derivedTerms = derivedIndex_.prefixRange(word);
+        r.estimate = 0;
+        r.length = word.size();
+        r.word = word;
+        for (uint32_t termId = r.terms.first; termId != r.terms.second; ++termId)
+            r.estimate += invertedIndex_.postingCount(termId);
+        for (uint32_t termId = r.derivedTerms.first; termId != r.derivedTerms.second; ++termId)
+            r.estimate += derivedIndex_.postingCount(termId);
+        ranges.push_back(r);
+    }
+
+    // Skip if there arent any // CONSTRAINT (2): |W| > 0
+    if (ranges.empty()) {
+        if (cursor)
+            cursor->atEnd = true;
+        return vector<pair<shared_ptr<Indexable>,short>>();
+    }
+
+    // The matches of a query that extends the last word of the previous query
+    // are among the matches of the previous query
+    bool extends = previous && previous->results && previous->query.size() == query.size()
+            && query.back().startsWith(previous->query.back());
+    for (size_t i = 0; extends && i + 1 < query.size(); ++i)
+        extends = query[i] == previous->query[i];
+
+    // Process the rarest word first, this keeps the intermediate results small.
+    // The last word of the query is processed last, it is the one being typed.
+    const WordRange lastWord = ranges.back();
+    ranges.pop_back();
+    std::sort(ranges.begin(), ranges.end(),
+              [](const WordRange &lhs, const WordRange &rhs){ return lhs.estimate < rhs.estimate; });
+    ranges.push_back(lastWord);
+
+    // Score the matches of a term by the relevance of the keyword and the
+    // fraction of the term covered by w. Derived terms are weighted down.
+    vector<uint32_t> ids;
+    vector<uint16_t> relevances;
+    auto appendMatches = [&](const InvertedIndex &index, uint32_t termId, float quality, ScoredPostingList &target){
+        ids.clear();
+        relevances.clear();
+        index.postings(termId, ids, relevances);
+        for (size_t i = 0; i < ids.size(); ++i)
+            target.push_back({ids[i], quality * relevances[i] / USHRT_MAX});
+    };
+    // Like appendMatches, but keeps the matches of the candidates only
+    auto appendCandidateMatches = [&](const InvertedIndex &index, uint32_t termId, float quality,
+                                      const ScoredPostingList &candidates, ScoredPostingList &target){
+        ids.clear();
+        relevances.clear();
+        index.postings(termId, ids, relevances);
+        if (candidates.size() < ids.size()) {
+            vector<uint32_t>::const_iterator id = ids.cbegin();
+            for (const ScoredPosting &candidate : candidates) {
+                id = std::lower_bound(id, ids.cend(), candidate.id);
+                if (id == ids.cend())
+                    break;
+                if (*id == candidate.id)
+                    target.push_back({*id, quality * relevances[static_cast<size_t>(id - ids.cbegin())] / USHRT_MAX});
+            }
+        } else {
+            ScoredPostingList::const_iterator candidate = candidates.cbegin();
+            for (size_t i = 0; i < ids.size(); ++i) {
+                candidate = std::lower_bound(candidate, candidates.cend(), ids[i],
+                                             [](const ScoredPosting &p, uint32_t id){ return p.id < id; });
+                if (candidate == candidates.cend())
+                    break;
+                if (candidate->id == ids[i])
+                    target.push_back({ids[i], quality * relevances[i] / USHRT_MAX});
+            }
+        }
+    };
+    auto quality = [&](const InvertedIndex &index, const WordRange &range, uint32_t termId){
+        const float prefixQuality = 0.5f + 0.5f * range.length / index.term(termId).size();
+        return (&index == &derivedIndex_) ? DERIVED_WEIGHT * prefixQuality : prefixQuality;
+    };
+
+    ScoredPostingList results;
+
+    if (ranges.size() == 1 && limit < ranges.front().estimate && !next) {
+
+        // A single word allows to stop early. Process the terms in descending
+        // order of the upper bound of their scores and stop as soon as the
+        // k-th best match beats the bound of the next term. The final score
+        // never exceeds the score of the word, so the top k are settled then.
+        // Refinements need all matches, the next keystroke narrows them.
+        const WordRange &range = ranges.front();
+        struct Bound { float score; uint32_t termId; const InvertedIndex *index; };
+        vector<Bound> bounds;
+        bounds.reserve(range.terms.second - range.terms.first + range.derivedTerms.second - range.derivedTerms.first);
+        for (uint32_t termId = range.terms.first; termId != range.terms.second; ++termId)
+            bounds.push_back({quality(invertedIndex_, range, termId) * invertedIndex_.maxRelevance(termId) / USHRT_MAX,
+                              termId, &invertedIndex_});
+        for (uint32_t termId = range.derivedTerms.first; termId != range.derivedTerms.second; ++termId)
+            bounds.push_back({quality(derivedIndex_, range, termId) * derivedIndex_.maxRelevance(termId) / USHRT_MAX,
+                              termId, &derivedIndex_});
+        std::sort(bounds.begin(), bounds.end(),
+                  [](const Bound &lhs, const Bound &rhs){ return lhs.score > rhs.score; });
+
+        // Check the threshold whenever the matches doubled, this amortizes
+        // the normalization of the list
+        size_t checked = 0;
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            if (isCanceled(token))
+                return vector<pair<shared_ptr<Indexable>,short>>();
+            appendMatches(*bounds[i].index, bounds[i].termId, quality(*bounds[i].index, range, bounds[i].termId), results);
+            if (i + 1 < bounds.size() && results.size() >= limit && results.size() >= 2 * checked) {
+                makeScoredPostingList(results);
+                checked = results.size();
+                if (kthScore(results, 1, limit, cursor) > bounds[i+1].score)
+                    break;
+            }
+        }
+        makeScoredPostingList(results);
+
+        return rank(results, static_cast<uint32_t>(ranges.size()), limit, cursor);
+    }
+
+    // The lists are shared with the refinements, intersections replace them
+    shared_ptr<const ScoredPostingList> matches;
+    for (vector<WordRange>::const_iterator it = ranges.cbegin(); it != ranges.cend(); ++it) {
+
+        if (isCanceled(token))
+            return vector<pair<shared_ptr<Indexable>,short>>();
+
+        // Reuse the matches of the word if the previous search had it
+        shared_ptr<const ScoredPostingList> wordMatches = (previous) ? previous->matches(it->word)
+                                                                     : shared_ptr<const ScoredPostingList>();
+
+        // Look the last word up among the candidates if there are less of
+        // them than postings. These are the matches of the previous query if
+        // this one extends it, else the matches of the other words.
+        const ScoredPostingList *candidates = nullptr;
+        if (!wordMatches && it + 1 == ranges.cend()) {
+            candidates = (extends) ? previous->results.get() : matches.get();
+            if (candidates && candidates->size() >= it->estimate)
+                candidates = nullptr;
+        }
+
+        if (!wordMatches) {
+            // Unite the sets that are mapped by words that begin with w ∈ W
+            shared_ptr<ScoredPostingList> target = std::make_shared<ScoredPostingList>();
+            if (candidates) {
+                for (uint32_t termId = it->terms.first; termId != it->terms.second; ++termId)
+                    appendCandidateMatches(invertedIndex_, termId, quality(invertedIndex_, *it, termId), *candidates, *target);
+                for (uint32_t termId = it->derivedTerms.first; termId != it->derivedTerms.second; ++termId)
+                    appendCandidateMatches(derivedIndex_, termId, quality(derivedIndex_, *it, termId), *candidates, *target);
+            } else {
+                target->reserve(it->estimate);
+                for (uint32_t termId = it->terms.first; termId != it->terms.second; ++termId)
+                    appendMatches(invertedIndex_, termId, quality(invertedIndex_, *it, termId), *target);
+                for (uint32_t termId = it->derivedTerms.first; termId != it->derivedTerms.second; ++termId)
+                    appendMatches(derivedIndex_, termId, quality(derivedIndex_, *it, termId), *target);
+            }
+            makeScoredPostingList(*target);
+            wordMatches = std::move(target);
+        }
+
+        // The matches among the candidates are not complete
+        if (next && !candidates)
+            next->words.emplace_back(it->word, wordMatches);
+
+        // Intersect all sets U_w with the results
+        if (!matches)
+            matches = std::move(wordMatches);
+        else {
+            shared_ptr<ScoredPostingList> intersection = std::make_shared<ScoredPostingList>();
+            intersect(*matches, *wordMatches, *intersection);
+            matches = std::move(intersection);
+        }
+
+        // Nothing left to intersect
+        if (matches->empty())
+            break;
+    }
+
+    if (next) {
+        next->query = std::move(query);
+        next->results = matches;
+    }
+
+    return rank(*matches, static_cast<uint32_t>(ranges.size()), limit, cursor);
+}
+
+
+
+/** ***************************************************************************/
+float Core::PrefixSearch::score(const ScoredPosting &match, uint32_t wordCount) const {
+    // Mean score of the words weighted by the fraction of the item words
+    // covered by the query
+    const float coverage = std::min(1.0f, static_cast<float>(wordCount) / std::max<uint16_t>(wordCounts_[match.id], 1));
+    return match.score / wordCount * (0.75f + 0.25f * coverage);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::appendDerivedMatches(const QString &word, ScoredPostingList &target) const {
+    const pair<uint32_t,uint32_t> terms = derivedIndex_.prefixRange(word);
+    vector<uint32_t> ids;
+    vector<uint16_t> relevances;
+    for (uint32_t termId = terms.first; termId != terms.second; ++termId) {
+        const float quality = DERIVED_WEIGHT * (0.5f + 0.5f * word.size() / derivedIndex_.term(termId).size());
+        ids.clear();
+        relevances.clear();
+        derivedIndex_.postings(termId, ids, relevances);
+        for (size_t i = 0; i < ids.size(); ++i)
+            target.push_back({ids[i], quality * relevances[i] / USHRT_MAX});
+    }
+}
+
+
+
+/** ***************************************************************************/
+float Core::PrefixSearch::kthScore(const ScoredPostingList &matches, uint32_t wordCount, size_t k,
+                                   const OfflineIndex::Cursor *cursor) const {
+
+    const Candidate after = (cursor) ? Candidate{cursor->score, cursor->id} : Candidate{std::numeric_limits<float>::infinity(), 0};
+
+    vector<float> scores;
+    scores.reserve(matches.size());
+    for (const ScoredPosting &match : matches) {
+        if (removed_[match.id])
+            continue;
+        const Candidate candidate{score(match, wordCount), match.id};
+        if (better(after, candidate))
+            scores.push_back(candidate.score);
+    }
+
+    if (scores.size() < k)
+        return -1.0f;
+
+    std::nth_element(scores.begin(), scores.begin() + (k - 1), scores.end(), std::greater<float>());
+    return scores[k - 1];
+}
+
+
+
+/** ***************************************************************************/
+vector<pair<shared_ptr<Core::Indexable>,short>> Core::PrefixSearch::rank(const ScoredPostingList &matches,
+                                                                         uint32_t wordCount,
+                                                                         size_t limit,
+                                                                         OfflineIndex::Cursor *cursor) const {
+
+    if (limit == 0 || (cursor && cursor->atEnd))
+        return vector<pair<shared_ptr<Indexable>,short>>();
+
+    const Candidate after = (cursor) ? Candidate{cursor->score, cursor->id} : Candidate{std::numeric_limits<float>::infinity(), 0};
+
+    // Select the top k using a heap with the worst candidate on top
+    vector<Candidate> heap;
+    heap.reserve(std::min(limit, matches.size()));
+    for (const ScoredPosting &match : matches) {
+
+        // Skip removed items and the ones ranked before the cursor
+        if (removed_[match.id])
+            continue;
+        const Candidate candidate{score(match, wordCount), match.id};
+        if (!better(after, candidate))
+            continue;
+
+        if (heap.size() < limit) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end(), better);
+        } else if (better(candidate, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), better);
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end(), better);
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), better);
+
+    // Advance the cursor past the last returned item
+    if (cursor) {
+        if (heap.size() < limit)
+            cursor->atEnd = true;
+        else {
+            cursor->score = heap.back().score;
+            cursor->id = heap.back().id;
+        }
+    }
+
+    // Materialize the selected items only
+    vector<pair<shared_ptr<Indexable>,short>> results;
+    results.reserve(heap.size());
+    for (const Candidate &candidate : heap)
+        results.emplace_back(item(candidate.id), static_cast<short>(candidate.score * SHRT_MAX));
+    return results;
 }
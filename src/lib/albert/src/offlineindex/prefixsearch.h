@@ -15,111 +15,213 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
-#include <map>
+#include <QHash>
+#include <QMutex>
 #include <memory>
-#include <set>
 #include <vector>
+#include "indexable.h"
 #include "indeximpl.h"
+#include "invertedindex.h"
+#include "postinglist.h"
 
 namespace Core {
 
-class Indexable;
-
-class PrefixSearch : public IndexImpl
+class IndexFile;
+
+/**
+ * @brief The OfflineIndex::Refinement class
+ * The matches of the words of a ranked search of a snapshot and the matches
+ * of the whole query. The lists are shared with the searches refined from it.
+ * Words whose matches were not computed completely are not kept. A search
+ * that extends the last word of the query looks the extended word up among
+ * the matches of the query only.
+ */
+class OfflineIndex::Refinement final
 {
 public:
 
-    PrefixSearch();
-    PrefixSearch(const PrefixSearch &rhs);
-    virtual ~PrefixSearch();
-
-    void add(std::shared_ptr<Indexable> idxble) override;
-    void clear() override;
-    std::vector<std::shared_ptr<Indexable>> search(const QString &req) const override;
-
-protected:
-
-    std::vector<std::shared_ptr<Indexable>> index_;
-    std::map<QString,std::set<uint>> invertedIndex_;
-};
-
-
-
-
-
-
-
-
-
-
+    /** The matches of word or null if they are not known */
+    std::shared_ptr<const ScoredPostingList> matches(const QString &word) const {
+        for (const std::pair<QString,std::shared_ptr<const ScoredPostingList>> &w : words)
+            if (w.first == word)
+                return w.second;
+        return std::shared_ptr<const ScoredPostingList>();
+    }
 
+    std::shared_ptr<const IndexImpl> snapshot;
+    std::vector<std::pair<QString,std::shared_ptr<const ScoredPostingList>>> words;
 
+    /** The words in the order of the query */
+    std::vector<QString> query;
 
+    /** The matches of the query before ranking or null if not known */
+    std::shared_ptr<const ScoredPostingList> results;
 
+};
 
+/**
+ * @brief The PrefixSearch class
+ * The store of the offline index. Maps the words of the items to the items
+ * and matches query words as prefixes of these words. The fuzzy search is an
+ * overlay of a snapshot of this store.
+ * Secondary tokens derived from the keywords, i.e. acronyms and camel case
+ * parts, are kept in a separate inverted index. Their matches are weighted
+ * down, hence they rank below direct matches.
+ * A store can be backed by a mapped index file. The inverted index then views
+ * the pools of the file and the items are created on first access.
+ * If fold is set the diacritics of keywords and queries are folded, see
+ * Tokenizer. The option is fixed for the lifetime of the store.
+ */
+class PrefixSearch final : public IndexImpl
+{
+    friend class FuzzySearch;
+    friend class InfixSearch;
 
+public:
 
+    explicit PrefixSearch(bool fold = false);
+    PrefixSearch(const PrefixSearch &rhs);
+    PrefixSearch(std::shared_ptr<const IndexFile> file, OfflineIndex::ItemFactory factory);
+    ~PrefixSearch();
 
+    IndexImpl *clone() const override;
 
+    /**
+     * @brief Merges the staged postings into the inverted index
+     * The inverted index is immutable, therefore postings added since the last
+     * build are staged and merged in a single rebuild. Searches build
+     * implicitly.
+     */
+    void build() const override;
 
+    void add(std::shared_ptr<Indexable> idxble) override;
+    void update(std::shared_ptr<Indexable> idxble) override;
+    void assign(const std::vector<std::shared_ptr<Indexable>> &idxbles) override;
+    void remove(const QString &id) override;
+    void clear() override;
 
-
-
-
-//    class CaseInsensitiveCompare;
-//    class CaseInsensitiveComparePrefix;
-
-//template<class C>
-//struct PrefixSearch<C>::CaseInsensitiveCompare
-//{
-//    inline bool operator()( Posting const &lhs, Posting const &rhs ) const {
-//		return (*this)(lhs.first, rhs.first);
-//	}
-
-//    inline bool operator()( QString const &lhs, Posting const &rhs ) const {
-//		return (*this)(lhs, rhs.first);
-//	}
-
-//    inline bool operator()( Posting const &lhs, QString const &rhs ) const {
-//		return (*this)(lhs.first, rhs);
-//	}
-
-//	inline bool operator()( QString const &lhs, QString const &rhs ) const {
-//		return lhs.compare(rhs, Qt::CaseInsensitive)<0;
-//	}
-//};
-
-///** ***************************************************************************/
-//template<class C>
-//struct PrefixSearch<C>::CaseInsensitiveComparePrefix
-//{
-//	inline bool operator()( Posting const &pre, Posting const &rhs ) const {
-//		return (*this)(pre.first, rhs.first);
-//	}
-
-//	inline bool operator()( QString const &pre, Posting const &rhs ) const {
-//		return (*this)(pre, rhs.first);
-//	}
-
-//	inline bool operator()( Posting const &pre, QString const &rhs ) const {
-//		return (*this)(pre.first, rhs);
-//	}
-
-//	inline bool operator()( QString const& pre, QString const& rhs ) const	{
-//		QString::const_iterator a,b;
-//		a = pre.cbegin();
-//		b = rhs.cbegin();
-//		QChar ca,cb;
-//		while (a != pre.cend() && b != rhs.cend()) {
-//			ca = a++->toLower();
-//			cb = b++->toLower();
-//			if (ca < cb)
-//				return true;
-//			if (ca > cb)
-//				return false;
-//		}
-//		return false;
-//	}
-//};
+    /**
+     * @brief Writes the store to an index file
+     * Must be called on published snapshots only. Removed items are dropped
+     * from the file.
+     */
+    bool save(const QString &path, const OfflineIndex::PayloadFunction &payload) const override;
+
+    OfflineIndex::Statistics statistics() const override;
+
+    std::vector<std::shared_ptr<Indexable>> search(const QString &req, const CancellationToken *token) const override;
+    std::vector<std::pair<std::shared_ptr<Indexable>,short>> searchScored(const QString &req, size_t limit,
+                                                                     OfflineIndex::Cursor *cursor,
+                                                                     const CancellationToken *token) const override;
+
+    /**
+     * @brief Ranked search reusing the matches of the unchanged words
+     * The matches of an extended last word are looked up among the previous
+     * matches. Does not stop early, the next search needs all matches.
+     * @param previous The state of a previous search of this store or null
+     * @param next Receives the matches of the words of this search
+     */
+    std::vector<std::pair<std::shared_ptr<Indexable>,short>> refineScored(const QString &req, size_t limit,
+                                                                     const OfflineIndex::Refinement *previous,
+                                                                     OfflineIndex::Refinement &next,
+                                                                     const CancellationToken *token) const;
+
+private:
+
+    std::vector<std::pair<std::shared_ptr<Indexable>,short>> searchScored(const QString &req, size_t limit,
+                                                                     OfflineIndex::Cursor *cursor,
+                                                                     const OfflineIndex::Refinement *previous,
+                                                                     OfflineIndex::Refinement *next,
+                                                                     const CancellationToken *token) const;
+
+    /**
+     * @brief Drops the removed items and their postings
+     * Renumbers the remaining items densely. Called with the build mutex
+     * locked.
+     */
+    void compact();
+
+    /**
+     * @brief The final score of a match
+     * The mean score of the query words weighted by the fraction of the item
+     * words covered by the query. Never exceeds the mean score.
+     */
+    float score(const ScoredPosting &match, uint32_t wordCount) const;
+
+    /**
+     * @brief Appends the weighted matches of the derived tokens starting with
+     * word to target
+     * Used by the overlays, which match derived tokens by prefix only.
+     */
+    void appendDerivedMatches(const QString &word, ScoredPostingList &target) const;
+
+    /**
+     * @brief The score of the k-th best match ranked behind the cursor
+     * @return The score or a negative value if there are less than k matches
+     */
+    float kthScore(const ScoredPostingList &matches, uint32_t wordCount, size_t k,
+                   const OfflineIndex::Cursor *cursor) const;
+
+    /**
+     * @brief Ranks the matches and returns the best of them
+     * @param matches The matches, the scores are the sum of the scores of each
+     * query word in [0,1]
+     * @param wordCount The number of query words
+     * @param limit The maximal number of returned items
+     * @param cursor If not null matches ranked before the cursor are skipped
+     * and the cursor is advanced past the returned items
+     * @return The items and their scores in descending order of the score
+     */
+    std::vector<std::pair<std::shared_ptr<Indexable>,short>> rank(const ScoredPostingList &matches,
+                                                                  uint32_t wordCount,
+                                                                  size_t limit,
+                                                                  OfflineIndex::Cursor *cursor) const;
+
+    /** The item with the given id, creates it if it is backed by the file */
+    std::shared_ptr<Indexable> item(uint32_t id) const;
+
+    /** The id of the item with the given id without creating it */
+    QString itemId(uint32_t id) const;
+
+    /** Fills ids_ lazily, writers only need it */
+    void loadIds();
+
+    // Removed items are tombstoned until the next compaction. Items backed by
+    // the file are null until first access, guarded by itemMutex_ then.
+    mutable std::vector<std::shared_ptr<Indexable>> index_;
+    std::vector<bool> removed_;
+    std::vector<uint16_t> wordCounts_;
+    std::vector<uint> keywordHashes_;
+    QHash<QString,uint32_t> ids_;
+    bool idsLoaded_ = true;
+    uint32_t removedCount_ = 0;
+    mutable InvertedIndex invertedIndex_;
+    mutable std::vector<InvertedIndex::Posting> stagedPostings_;
+    mutable InvertedIndex derivedIndex_;
+    mutable std::vector<InvertedIndex::Posting> stagedDerivedPostings_;
+    mutable QMutex buildMutex_;
+
+    // The rows of the items in the file, UINT32_MAX for items added later
+    std::shared_ptr<const IndexFile> file_;
+    std::vector<uint32_t> rows_;
+    OfflineIndex::ItemFactory factory_;
+    mutable QMutex itemMutex_;
+
+    const bool fold_;
+
+    void insert(std::shared_ptr<Indexable> idxble,
+                const std::vector<Indexable::WeightedKeyword> &keywords,
+                uint keywordHash);
+
+    void erase(uint32_t id);
+
+    static bool equal(const std::vector<Indexable::WeightedKeyword> &lhs,
+                      const std::vector<Indexable::WeightedKeyword> &rhs);
+
+    static uint hash(const std::vector<Indexable::WeightedKeyword> &keywords);
+
+    // The number of words of the keywords as counted by insert
+    uint16_t wordCount(const std::vector<Indexable::WeightedKeyword> &keywords) const;
+};
 
 }
@@ -0,0 +1,96 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <climits>
+#include <utility>
+#include "invertedindex.h"
+#include "qgramindex.h"
+using std::pair;
+using std::vector;
+
+
+/** ***************************************************************************/
+void Core::QGramIndex::qGrams(const QString &word, uint q, vector<uint64_t> &qGrams) {
+    // Slide a window over the padded word, shifting in one code unit per step
+    const uint64_t mask = (q < 4) ? (uint64_t(1) << (16 * q)) - 1 : ~uint64_t(0);
+    uint64_t qGram = 0;
+    for (uint i = 0; i + 1 < q; ++i)
+        qGram = (qGram << 16) | ' ';
+    for (const QChar &c : word) {
+        qGram = ((qGram << 16) | c.unicode()) & mask;
+        qGrams.push_back(qGram);
+    }
+}
+
+
+/** ***************************************************************************/
+void Core::QGramIndex::build(const InvertedIndex &dictionary, uint q) {
+
+    clear();
+
+    // Collect a pair of qGram and term id for every occurence
+    vector<pair<uint64_t,uint32_t>> occurences;
+    vector<uint64_t> termQGrams;
+    for (uint32_t termId = 0; termId < dictionary.termCount(); ++termId) {
+        termQGrams.clear();
+        qGrams(dictionary.term(termId), q, termQGrams);
+        for (uint64_t qGram : termQGrams)
+            occurences.emplace_back(qGram, termId);
+    }
+    std::sort(occurences.begin(), occurences.end());
+
+    // Count the equal pairs and group them by qGram
+    for (vector<pair<uint64_t,uint32_t>>::const_iterator it = occurences.cbegin(); it != occurences.cend(); ) {
+        vector<pair<uint64_t,uint32_t>>::const_iterator end = it + 1;
+        while (end != occurences.cend() && *end == *it)
+            ++end;
+        if (qGrams_.empty() || qGrams_.back() != it->first) {
+            if (!qGrams_.empty())
+                offsets_.push_back(static_cast<uint32_t>(termIds_.size()));
+            qGrams_.push_back(it->first);
+        }
+        termIds_.push_back(it->second);
+        counts_.push_back(static_cast<uint8_t>(std::min<std::ptrdiff_t>(end - it, UCHAR_MAX)));
+        it = end;
+    }
+    if (!qGrams_.empty())
+        offsets_.push_back(static_cast<uint32_t>(termIds_.size()));
+
+    qGrams_.shrink_to_fit();
+    offsets_.shrink_to_fit();
+    termIds_.shrink_to_fit();
+    counts_.shrink_to_fit();
+}
+
+
+/** ***************************************************************************/
+void Core::QGramIndex::clear() {
+    qGrams_.clear();
+    offsets_.assign(1, 0);
+    termIds_.clear();
+    counts_.clear();
+}
+
+
+/** ***************************************************************************/
+Core::QGramIndex::Postings Core::QGramIndex::postings(uint64_t qGram) const {
+    vector<uint64_t>::const_iterator it = std::lower_bound(qGrams_.cbegin(), qGrams_.cend(), qGram);
+    if (it == qGrams_.cend() || *it != qGram)
+        return Postings{nullptr, nullptr, 0};
+    const size_t i = static_cast<size_t>(it - qGrams_.cbegin());
+    return Postings{termIds_.data() + offsets_[i], counts_.data() + offsets_[i], offsets_[i+1] - offsets_[i]};
+}
@@ -0,0 +1,64 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+namespace Core {
+
+class InvertedIndex;
+
+/**
+ * @brief The QGramIndex class
+ * A compact, immutable index mapping the qGrams of the terms of a dictionary
+ * to the ids of the terms. The words are padded by q-1 leading spaces. A qGram
+ * of up to four UTF-16 code units is packed into an integer. The postings of a
+ * qGram are the ascending ids of the terms containing it, accompanied by the
+ * number of occurences, stored back to back in flat arrays.
+ */
+class QGramIndex final
+{
+public:
+
+    struct Postings {
+        const uint32_t *termIds;
+        const uint8_t *counts;
+        size_t size;
+    };
+
+    /** Appends the packed qGrams of word to qGrams, q must not exceed 4. */
+    static void qGrams(const QString &word, uint q, std::vector<uint64_t> &qGrams);
+
+    /** Rebuilds the index from the terms of the dictionary. */
+    void build(const InvertedIndex &dictionary, uint q);
+
+    void clear();
+
+    /** The postings of the packed qGram, empty if it is not in the index. */
+    Postings postings(uint64_t qGram) const;
+
+private:
+
+    std::vector<uint64_t> qGrams_;
+    std::vector<uint32_t> offsets_ = {0};
+    std::vector<uint32_t> termIds_;
+    std::vector<uint8_t> counts_;
+
+};
+
+}
@@ -0,0 +1,71 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include "invertedindex.h"
+#include "suffixarray.h"
+using std::pair;
+using std::vector;
+
+
+/** ***************************************************************************/
+void Core::SuffixArray::build(const InvertedIndex &dictionary) {
+
+    clear();
+
+    for (uint32_t termId = 0; termId < dictionary.termCount(); ++termId) {
+        const uint32_t length = static_cast<uint32_t>(dictionary.term(termId).size());
+        for (uint32_t offset = 0; offset < length; ++offset)
+            suffixes_.push_back({termId, offset});
+    }
+
+    // Equal suffixes are ordered by term id
+    std::sort(suffixes_.begin(), suffixes_.end(), [&dictionary](const Suffix &lhs, const Suffix &rhs){
+        const int cmp = suffix(dictionary, lhs).compare(suffix(dictionary, rhs));
+        return cmp < 0 || (cmp == 0 && lhs.termId < rhs.termId);
+    });
+
+    suffixes_.shrink_to_fit();
+}
+
+
+/** ***************************************************************************/
+void Core::SuffixArray::clear() {
+    suffixes_.clear();
+}
+
+
+/** ***************************************************************************/
+pair<const Core::SuffixArray::Suffix*, const Core::SuffixArray::Suffix*>
+Core::SuffixArray::find(const InvertedIndex &dictionary, const QString &pattern) const {
+
+    // The first suffix not less than the pattern
+    const Suffix *lb = std::lower_bound(suffixes_.data(), suffixes_.data() + suffixes_.size(), pattern,
+                                        [&dictionary](const Suffix &s, const QString &p){ return suffix(dictionary, s) < p; });
+
+    // Suffixes starting with the pattern are contiguous from here on
+    const Suffix *ub = std::partition_point(lb, suffixes_.data() + suffixes_.size(),
+                                            [&dictionary, &pattern](const Suffix &s){ return suffix(dictionary, s).startsWith(pattern); });
+
+    return std::make_pair(lb, ub);
+}
+
+
+/** ***************************************************************************/
+QString Core::SuffixArray::suffix(const InvertedIndex &dictionary, const Suffix &suffix) {
+    const QString term = dictionary.term(suffix.termId);
+    return QString::fromRawData(term.unicode() + suffix.offset, term.size() - static_cast<int>(suffix.offset));
+}
@@ -0,0 +1,61 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Core {
+
+class InvertedIndex;
+
+/**
+ * @brief The SuffixArray class
+ * The sorted suffixes of the terms of a dictionary. A suffix is addressed by
+ * the id of its term and its offset in the term, the characters are looked up
+ * in the dictionary. The suffixes starting with a pattern are contiguous,
+ * hence the terms containing a pattern are found by two binary searches in
+ * O(|pattern| log n).
+ */
+class SuffixArray final
+{
+public:
+
+    struct Suffix {
+        uint32_t termId;
+        uint32_t offset;
+    };
+
+    /** Rebuilds the array from the terms of the dictionary. */
+    void build(const InvertedIndex &dictionary);
+
+    void clear();
+
+    /** The half open range of the suffixes starting with pattern. */
+    std::pair<const Suffix*, const Suffix*> find(const InvertedIndex &dictionary, const QString &pattern) const;
+
+private:
+
+    /** The characters of the suffix. The returned string does not own its data. */
+    static QString suffix(const InvertedIndex &dictionary, const Suffix &suffix);
+
+    std::vector<Suffix> suffixes_;
+
+};
+
+}
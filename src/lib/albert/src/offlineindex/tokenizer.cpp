@@ -0,0 +1,188 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include "tokenizer.h"
+using std::vector;
+
+namespace {
+
+/**
+ * @brief The folded, lower cased forms of all UTF-16 code units
+ * The NFKD decomposition of a code unit stripped of combining marks. The
+ * forms are stored back to back in a pool, addressed by offsets. Surrogates
+ * and Hangul syllables, which decompose into letters rather than a letter and
+ * marks, map to themselves.
+ */
+class FoldTable final
+{
+public:
+
+    FoldTable() {
+        offsets_.reserve(0x10000 + 1);
+        for (uint unicode = 0; unicode < 0x10000; ++unicode) {
+            offsets_.push_back(static_cast<uint32_t>(pool_.size()));
+            const QChar c(static_cast<ushort>(unicode));
+            if (c.isSurrogate() || (0xAC00 <= unicode && unicode <= 0xD7A3))
+                pool_.push_back(c);
+            else
+                for (const QChar &d : QString(c).normalized(QString::NormalizationForm_KD))
+                    if (!d.isMark())
+                        pool_.push_back(d.toLower());
+        }
+        offsets_.push_back(static_cast<uint32_t>(pool_.size()));
+    }
+
+    void append(QChar c, QString &out) const {
+        const uint32_t offset = offsets_[c.unicode()];
+        out.append(pool_.data() + offset, static_cast<int>(offsets_[c.unicode() + 1] - offset));
+    }
+
+private:
+
+    std::vector<uint32_t> offsets_;
+    std::vector<QChar> pool_;
+
+};
+
+}
+
+
+/** ***************************************************************************/
+const bool Core::Tokenizer::separatorTable_[128] = {
+//  NUL    SOH    STX    ETX    EOT    ENQ    ACK    BEL    BS     HT     LF     VT     FF     CR     SO     SI
+    false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false,
+//  DLE    DC1    DC2    DC3    DC4    NAK    SYN    ETB    CAN    EM     SUB    ESC    FS     GS     RS     US
+    false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false,
+//  ' '    !      "      #      $      %      &      '      (      )      *      +      ,      -      .      /
+    true,  true,  true,  false, false, false, false, true,  false, false, true,  true,  true,  true,  true,  true,
+//  0      1      2      3      4      5      6      7      8      9      :      ;      <      =      >      ?
+    false, false, false, false, false, false, false, false, false, false, true,  true,  true,  true,  true,  true,
+//  @      A      B      C      D      E      F      G      H      I      J      K      L      M      N      O
+    false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false,
+//  P      Q      R      S      T      U      V      W      X      Y      Z      [      \      ]      ^      _
+    false, false, false, false, false, false, false, false, false, false, false, false, true,  false, false, true,
+//  `      a      b      c      d      e      f      g      h      i      j      k      l      m      n      o
+    false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false,
+//  p      q      r      s      t      u      v      w      x      y      z      {      |      }      ~      DEL
+    false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false
+};
+
+
+/** ***************************************************************************/
+Core::Tokenizer::Tokenizer(const QString &str, bool fold)
+    : it_(str.constData()), end_(str.constData() + str.size()), fold_(fold) {
+
+}
+
+
+/** ***************************************************************************/
+bool Core::Tokenizer::next(QString &token) {
+
+    do {
+        // Skip the separators
+        while (it_ != end_ && isSeparator(*it_))
+            ++it_;
+
+        if (it_ == end_)
+            return false;
+
+        // Find the end of the word
+        const QChar *begin = it_;
+        while (it_ != end_ && !isSeparator(*it_))
+            ++it_;
+
+        lower(begin, it_, fold_, token);
+
+    // Words of combining marks only vanish when folded
+    } while (token.isEmpty());
+
+    return true;
+}
+
+
+/** ***************************************************************************/
+void Core::Tokenizer::derive(const QString &str, vector<QString> &tokens, bool fold) {
+
+    QString acronym;
+    QString token;
+    const QChar *it = str.constData();
+    const QChar *end = it + str.size();
+    forever {
+
+        // Skip the separators
+        while (it != end && isSeparator(*it))
+            ++it;
+
+        if (it == end)
+            break;
+
+        // A part starts at a lower to upper case transition and before the
+        // last capital of a run of capitals followed by a lower case letter,
+        // e.g. "XMLParser" consists of "XML" and "Parser"
+        const QChar *word = it;
+        const QChar *part = it;
+        auto appendPart = [&](){
+            lower(part, part + 1, fold, token);
+            acronym.append(token);
+            if (part != word) {
+                lower(part, it, fold, token);
+                if (!token.isEmpty())
+                    tokens.push_back(token);
+            }
+        };
+        for (++it; it != end && !isSeparator(*it); ++it) {
+            const QChar *previous = it - 1;
+            const QChar *next = it + 1;
+            if (it->isUpper() && (previous->isLower() || previous->isDigit()
+                                  || (previous->isUpper() && next != end && next->isLower()))) {
+                appendPart();
+                part = it;
+            }
+        }
+        appendPart();
+    }
+
+    if (acronym.size() > 1)
+        tokens.push_back(acronym);
+}
+
+
+/** ***************************************************************************/
+void Core::Tokenizer::lower(const QChar *begin, const QChar *end, bool fold, QString &token) {
+
+    // Check if the word is plain ASCII
+    ushort ascii = 0;
+    for (const QChar *c = begin; c != end; ++c)
+        ascii |= c->unicode();
+
+    const int length = static_cast<int>(end - begin);
+    if (ascii < 128) {
+        // Lower ASCII in place
+        token.resize(length);
+        QChar *out = token.data();
+        for (const QChar *c = begin; c != end; ++c, ++out)
+            *out = ('A' <= c->unicode() && c->unicode() <= 'Z') ? QChar(c->unicode() + 32) : *c;
+    } else if (fold) {
+        // Look up the folded forms
+        static const FoldTable foldTable;
+        token.clear();
+        for (const QChar *c = begin; c != end; ++c)
+            foldTable.append(*c, token);
+    } else
+        // Let Qt handle the special cases of unicode case mapping
+        token = QString(begin, length).toLower();
+}
@@ -0,0 +1,78 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <vector>
+
+namespace Core {
+
+/**
+ * @brief The Tokenizer class
+ * Splits a string into lower cased words. Words are separated by runs of the
+ * characters !?<>"'=+*.:,;\/_- and space. The string is scanned in place
+ * using a lookup table, i.e. there is no regular expression and no temporary
+ * list involved.
+ * Optionally diacritics are folded, i.e. the words are NFKD normalized and
+ * stripped of combining marks, e.g. "Résumé" becomes "resume". The folded
+ * form of every UTF-16 code unit is precomputed in a table on first use.
+ *
+ * Usage: Tokenizer tokenizer(str); QString w; while (tokenizer.next(w)) ...
+ */
+class Tokenizer final
+{
+public:
+
+    explicit Tokenizer(const QString &str, bool fold = false);
+
+    /**
+     * @brief Fetches the next word
+     * @param token Receives the lower cased word. Passing the same string
+     * repeatedly reuses its buffer.
+     * @return False if there are no words left
+     */
+    bool next(QString &token);
+
+    /**
+     * @brief Derives secondary tokens from the words of a string
+     * Words are split into their camel case parts, e.g. "LibreOffice" into
+     * "libre" and "office". Appends the lower cased parts except the first one
+     * of every word, which is a prefix of the word anyway, and the acronym
+     * made of the initials of all parts, e.g. "low" for "LibreOffice Writer"
+     * and "gsm" for "gnome-system-monitor".
+     */
+    static void derive(const QString &str, std::vector<QString> &tokens, bool fold = false);
+
+    /**
+     * @brief Checks if the character separates words
+     */
+    static bool isSeparator(QChar c) {
+        return c.unicode() < 128 && separatorTable_[c.unicode()];
+    }
+
+private:
+
+    /** Lower cases and optionally folds the characters in [begin,end) into token */
+    static void lower(const QChar *begin, const QChar *end, bool fold, QString &token);
+
+    const QChar *it_;
+    const QChar *end_;
+    const bool fold_;
+    static const bool separatorTable_[128];
+
+};
+
+}
@@ -22,6 +22,10 @@ StandardIndexItem::StandardIndexItem(const QString &id) : StandardItem(id) {
 
 }
 
+QString StandardIndexItem::id() const {
+    return StandardItem::id();
+}
+
 std::vector<Indexable::WeightedKeyword> StandardIndexItem::indexKeywords() const {
     return indexKeywords_;
 }
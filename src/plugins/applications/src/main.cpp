@@ -21,12 +21,12 @@
 #include <QDebug>
 #include <QFile>
 #include <QFileSystemWatcher>
+#include <QFutureWatcher>
 #include <QPointer>
 #include <QProcess>
 #include <QRegularExpression>
 #include <QSettings>
 #include <QStandardPaths>
-#include <QtConcurrent>
 #include <QTimer>
 #include <QThread>
 #include <algorithm>
@@ -37,6 +37,7 @@
 #include "main.h"
 #include "offlineindex.h"
 #include "query.h"
+#include "queryexecutor.h"
 #include "queryhandler.h"
 #include "standardaction.h"
 #include "standardindexitem.h"
@@ -513,8 +514,16 @@ void Applications::ApplicationsPrivate::startIndexing() {
     QObject::connect(&futureWatcher, &QFutureWatcher<vector<shared_ptr<Core::StandardIndexItem>>>::finished,
                      std::bind(&ApplicationsPrivate::finishIndexing, this));
 
-    // Run the indexer thread
-    futureWatcher.setFuture(QtConcurrent::run(indexApplications, ignoreShowInKeys));
+    // Run the indexer thread, it publishes the offline index too. It gets a
+    // copy of the settings, the offline index is thread safe.
+    const bool ignoreShowInKeys = this->ignoreShowInKeys;
+    Core::OfflineIndex *offlineIndex = &this->offlineIndex;
+    futureWatcher.setFuture(QueryExecutor::instance->run(QueryExecutor::Lane::Background, [ignoreShowInKeys, offlineIndex](){
+        vector<shared_ptr<Core::StandardIndexItem>> newIndex = indexApplications(ignoreShowInKeys);
+        offlineIndex->assign(newIndex);
+        offlineIndex->commit();
+        return newIndex;
+    }));
 
     // Notification
     qDebug() << "Start indexing applications.";
@@ -526,14 +535,9 @@ void Applications::ApplicationsPrivate::startIndexing() {
 /** ***************************************************************************/
 void Applications::ApplicationsPrivate::finishIndexing() {
 
-    // Get the thread results
+    // Get the thread results, the offline index has been published already
     index = futureWatcher.future().result();
 
-    // Rebuild the offline index
-    offlineIndex.clear();
-    for (const auto &item : index)
-        offlineIndex.add(item);
-
     // Finally update the watches (maybe folders changed)
     if (!watcher.directories().isEmpty())
         watcher.removePaths(watcher.directories());
@@ -572,6 +576,7 @@ Applications::Extension::Extension()
     QSettings s(qApp->applicationName());
     s.beginGroup(Core::Extension::id);
     d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    d->offlineIndex.setFoldDiacritics();
     d->ignoreShowInKeys = s.value(CFG_IGNORESHOWINKEYS, DEF_IGNORESHOWINKEYS).toBool();
 
     // If the filesystem changed, trigger the scan
@@ -625,13 +630,13 @@ QWidget *Applications::Extension::widget(QWidget *parent) {
 void Applications::Extension::handleQuery(Core::Query * query) {
 
     // Search for matches
-    const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
+    const vector<pair<shared_ptr<Core::Indexable>,short>> &indexables = d->offlineIndex.searchScored(query->searchTerm(), SIZE_MAX, nullptr,
+                                                                                                     &query->cancellationToken());
 
     // Add results to query
     vector<pair<shared_ptr<Core::Item>,short>> results;
-    for (const shared_ptr<Core::Indexable> &item : indexables)
-        // TODO `Search` has to determine the relevance. Set to 0 for now
-        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item), 1);
+    for (const pair<shared_ptr<Core::Indexable>,short> &item : indexables)
+        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item.first), item.second);
 
     query->addMatches(results.begin(), results.end());
 }
@@ -32,7 +32,6 @@
 #include <QProcess>
 #include <QSettings>
 #include <QStandardPaths>
-#include <QtConcurrent>
 #include <QTimer>
 #include <QUrl>
 #include <functional>
@@ -43,6 +42,7 @@
 #include "indexable.h"
 #include "offlineindex.h"
 #include "query.h"
+#include "queryexecutor.h"
 #include "queryhandler.h"
 #include "standardaction.h"
 #include "standardindexitem.h"
@@ -177,8 +177,16 @@ void ChromeBookmarks::ChromeBookmarksPrivate::startIndexing() {
     QObject::connect(&futureWatcher, &QFutureWatcher<vector<shared_ptr<Core::StandardIndexItem>>>::finished,
                      std::bind(&ChromeBookmarksPrivate::finishIndexing, this));
 
-    // Run the indexer thread
-    futureWatcher.setFuture(QtConcurrent::run(indexChromeBookmarks, bookmarksFile));
+    // Run the indexer thread, it publishes the offline index too. It gets a
+    // copy of the path, the offline index is thread safe.
+    const QString bookmarksFile = this->bookmarksFile;
+    Core::OfflineIndex *offlineIndex = &this->offlineIndex;
+    futureWatcher.setFuture(QueryExecutor::instance->run(QueryExecutor::Lane::Background, [bookmarksFile, offlineIndex](){
+        vector<shared_ptr<Core::StandardIndexItem>> newIndex = indexChromeBookmarks(bookmarksFile);
+        offlineIndex->assign(newIndex);
+        offlineIndex->commit();
+        return newIndex;
+    }));
 
     // Notification
     qDebug() << "Start indexing Chrome bookmarks.";
@@ -191,14 +199,9 @@ void ChromeBookmarks::ChromeBookmarksPrivate::startIndexing() {
 /** ***************************************************************************/
 void ChromeBookmarks::ChromeBookmarksPrivate::finishIndexing() {
 
-    // Get the thread results
+    // Get the thread results, the offline index has been published already
     index = futureWatcher.future().result();
 
-    // Rebuild the offline index
-    offlineIndex.clear();
-    for (const auto &item : index)
-        offlineIndex.add(item);
-
     /*
      * Finally update the watches (maybe folders changed)
      * Note that QFileSystemWatcher stops monitoring files once they have been
@@ -230,6 +233,7 @@ ChromeBookmarks::Extension::Extension()
     QSettings s(qApp->applicationName());
     s.beginGroup(Core::Extension::id);
     d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    d->offlineIndex.setFoldDiacritics();
 
     // Load and set a valid path
     QVariant v = s.value(CFG_PATH);
@@ -261,7 +265,7 @@ ChromeBookmarks::Extension::Extension()
 
 /** ***************************************************************************/
 ChromeBookmarks::Extension::~Extension() {
-
+    d->futureWatcher.waitForFinished();
 }
 
 
@@ -295,12 +299,13 @@ QWidget *ChromeBookmarks::Extension::widget(QWidget *parent) {
 void ChromeBookmarks::Extension::handleQuery(Core::Query * query) {
 
     // Search for matches
-    const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
+    const vector<pair<shared_ptr<Core::Indexable>,short>> &indexables = d->offlineIndex.searchScored(query->searchTerm(), SIZE_MAX, nullptr,
+                                                                                                     &query->cancellationToken());
 
     // Add results to query
     vector<pair<shared_ptr<Core::Item>,short>> results;
-    for (const shared_ptr<Core::Indexable> &item : indexables)
-        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item), 0);
+    for (const pair<shared_ptr<Core::Indexable>,short> &item : indexables)
+        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item.first), item.second);
 
     query->addMatches(results.begin(), results.end());
 }
@@ -19,7 +19,8 @@
 #include <QPointer>
 #include <QSettings>
 #include <chrono>
-#include <thread>
+#include <condition_variable>
+#include <mutex>
 #include "configwidget.h"
 #include "main.h"
 #include "query.h"
@@ -84,13 +85,24 @@ void Debug::Extension::handleQuery(Core::Query * query) {
     if (!query->isValid())
         return;
 
+    // Wake up as soon as the query gets canceled
+    const Core::CancellationToken &token = query->cancellationToken();
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    uint callback = token.connect([&mutex, &wakeUp](){
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeUp.notify_all();
+    });
+
     for (int i = 0 ; i < d->count; ++i){
 
-        if (d->async)
-            std::this_thread::sleep_for(std::chrono::milliseconds(d->delay));
+        if (d->async) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait_for(lock, std::chrono::milliseconds(d->delay), [&token](){ return token.isCanceled(); });
+        }
 
         if (!query->isValid())
-            return;
+            break;
 
         std::shared_ptr<StandardItem> item = std::make_shared<StandardItem>(QString::number(i));
         item->setText(QString("Das Item #%1").arg(i));
@@ -98,6 +110,8 @@ void Debug::Extension::handleQuery(Core::Query * query) {
         item->setIconPath(":debug");
         query->addMatch(item, 0);
     }
+
+    token.disconnect(callback);
 }
 
 
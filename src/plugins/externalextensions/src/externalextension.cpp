@@ -38,10 +38,14 @@ using namespace Core;
 
 namespace {
 
+// The interval in milliseconds a running process checks for cancellation
+const int CANCELLATION_POLL_INTERVAL = 20;
+
 bool runProcess (QString path,
                  std::map<QString, QString> *variables,
                  QByteArray *out,
-                 QString *errorString) {
+                 QString *errorString,
+                 const CancellationToken *token = nullptr) {
 
     // Run the process
     QProcess process;
@@ -51,7 +55,15 @@ bool runProcess (QString path,
     process.setProcessEnvironment(env);
     process.setProgram(path);
     process.start();
-    process.waitForFinished(-1);
+    while ( !process.waitForFinished(CANCELLATION_POLL_INTERVAL) && process.state() != QProcess::NotRunning ) {
+        // Nobody is interested in the output anymore, do not let it run on
+        if ( token && token->isCanceled() ) {
+            process.kill();
+            process.waitForFinished(-1);
+            *errorString = QString("Process canceled.");
+            return false;
+        }
+    }
 
     if ( process.exitStatus() != QProcess::NormalExit ) {
         *errorString = QString("Process crashed.");
@@ -308,10 +320,16 @@ void ExternalExtensions::ExternalExtension::handleQuery(Query* query) {
     QJsonObject object;
     QByteArray out;
 
+    // The query may have been canceled while waiting for the lock
+    if ( !query->isValid() )
+        return;
+
     // Run the process
     variables_["ALBERT_OP"] = "QUERY";
     variables_["ALBERT_QUERY"] = query->searchTerm();
-    if ( !runProcess(path_, &variables_, &out, &errorString) ) {
+    if ( !runProcess(path_, &variables_, &out, &errorString, &query->cancellationToken()) ) {
+        if ( !query->isValid() )
+            return;
         qWarning() << qPrintable(QString("Handle query failed: %1 (%2)").arg(errorString, path_));
         return;
     }
@@ -23,9 +23,8 @@
 #include <QPointer>
 #include <QSettings>
 #include <QStandardPaths>
-#include <QtConcurrent>
-#include <QThreadPool>
 #include <QTimer>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "configwidget.h"
@@ -33,6 +32,7 @@
 #include "main.h"
 #include "offlineindex.h"
 #include "query.h"
+#include "queryexecutor.h"
 #include "queryhandler.h"
 #include "standarditem.h"
 #include "standardaction.h"
@@ -64,6 +64,7 @@ const bool  DEF_FOLLOW_SYMLINKS = false;
 const char* CFG_SCAN_INTERVAL   = "scan_interval";
 const uint  DEF_SCAN_INTERVAL   = 60;
 const char* IGNOREFILE          = ".albertignore";
+const size_t MAX_RESULTS        = 250;
 
 }
 
@@ -87,7 +88,7 @@ public:
     Core::OfflineIndex offlineIndex;
     QFutureWatcher<vector<shared_ptr<File>>> futureWatcher;
     QTimer indexIntervalTimer;
-    bool abort;
+    std::atomic<bool> abort;
     bool rerun;
 
     // Index Properties
@@ -99,9 +100,21 @@ public:
     bool indexHidden;
     bool followSymlinks;
 
+    // The settings of a scan, the indexer thread works on a copy
+    struct IndexSettings {
+        QStringList rootDirs;
+        bool indexAudio;
+        bool indexVideo;
+        bool indexImage;
+        bool indexDocs;
+        bool indexDirs;
+        bool indexHidden;
+        bool followSymlinks;
+    };
+
     void finishIndexing();
     void startIndexing();
-    vector<shared_ptr<File>> indexFiles() const;
+    vector<shared_ptr<File>> indexFiles(const IndexSettings &settings);
 };
 
 
@@ -126,8 +139,12 @@ void Files::FilesPrivate::startIndexing() {
     if (indexIntervalTimer.interval() != 0)
         indexIntervalTimer.start();
 
-    // Run the indexer thread
-    futureWatcher.setFuture(QtConcurrent::run(this, &FilesPrivate::indexFiles));
+    // Run the indexer thread on a copy of the settings. Besides that it uses
+    // the abort flag and the offline index only, both are thread safe.
+    const IndexSettings settings = {rootDirs, indexAudio, indexVideo, indexImage,
+                                    indexDocs, indexDirs, indexHidden, followSymlinks};
+    futureWatcher.setFuture(QueryExecutor::instance->run(QueryExecutor::Lane::Background,
+                                                         std::bind(&FilesPrivate::indexFiles, this, settings)));
 
     // Notification
     qDebug() << "Start indexing files.";
@@ -139,16 +156,12 @@ void Files::FilesPrivate::startIndexing() {
 /** ***************************************************************************/
 void Files::FilesPrivate::finishIndexing() {
 
-    // In case of abortion the returned data is invalid
-    if ( !abort ) {
+    // In case of abortion the returned data is invalid. An indexer aborted
+    // after publishing the offline index returns the published files though.
+    if ( !abort || !futureWatcher.future().result().empty() ) {
         // Get the thread results
         index = futureWatcher.future().result();
 
-        // Rebuild the offline index
-        offlineIndex.clear();
-        for (const auto &item : index)
-            offlineIndex.add(item);
-
         // Notification
         qDebug() << qPrintable(QString("Indexed %1 files.").arg(index.size()));
         emit q->statusInfo(QString("%1 files indexed.").arg(index.size()));
@@ -165,7 +178,7 @@ void Files::FilesPrivate::finishIndexing() {
 
 
 /** ***************************************************************************/
-vector<shared_ptr<Files::File>> Files::FilesPrivate::indexFiles() const {
+vector<shared_ptr<Files::File>> Files::FilesPrivate::indexFiles(const IndexSettings &settings) {
 
     // Get a new index
     std::vector<shared_ptr<File>> newIndex;
@@ -174,12 +187,12 @@ vector<shared_ptr<Files::File>> Files::FilesPrivate::indexFiles() const {
 
     // Prepare the iterator properties
     QDir::Filters filters = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot;
-    if (indexHidden)
+    if (settings.indexHidden)
         filters |= QDir::Hidden;
 
     // Anonymous function that implemnents the index recursion
     std::function<void(const QFileInfo&)> indexRecursion =
-            [this, &mimeDatabase, &newIndex, &indexedDirs, &filters, &indexRecursion](const QFileInfo& fileInfo){
+            [this, &settings, &mimeDatabase, &newIndex, &indexedDirs, &filters, &indexRecursion](const QFileInfo& fileInfo){
 
         if (abort) return;
 
@@ -190,10 +203,10 @@ vector<shared_ptr<Files::File>> Files::FilesPrivate::indexFiles() const {
             // If the file matches the index options, index it
             QMimeType mimetype = mimeDatabase.mimeTypeForFile(canonicalPath);
             const QString mimeName = mimetype.name();
-            if ((indexAudio && mimeName.startsWith("audio"))
-                    ||(indexVideo && mimeName.startsWith("video"))
-                    ||(indexImage && mimeName.startsWith("image"))
-                    ||(indexDocs &&
+            if ((settings.indexAudio && mimeName.startsWith("audio"))
+                    ||(settings.indexVideo && mimeName.startsWith("video"))
+                    ||(settings.indexImage && mimeName.startsWith("image"))
+                    ||(settings.indexDocs &&
                        (mimeName.startsWith("application") || mimeName.startsWith("text")))) {
                 newIndex.push_back(std::make_shared<File>(canonicalPath, mimetype));
             }
@@ -209,7 +222,7 @@ vector<shared_ptr<Files::File>> Files::FilesPrivate::indexFiles() const {
             indexedDirs.insert(canonicalPath);
 
             // If the dir matches the index options, index it
-            if (indexDirs) {
+            if (settings.indexDirs) {
                 QMimeType mimetype = mimeDatabase.mimeTypeForFile(canonicalPath);
                 newIndex.push_back(std::make_shared<File>(canonicalPath, mimetype));
             }
@@ -240,7 +253,7 @@ vector<shared_ptr<Files::File>> Files::FilesPrivate::indexFiles() const {
                     continue;
 
                 // Skip if this file is a symlink and we shoud skip symlinks
-                if (fileInfo.isSymLink() && !followSymlinks)
+                if (fileInfo.isSymLink() && !settings.followSymlinks)
                     continue;
 
                 // Index this file
@@ -250,21 +263,26 @@ vector<shared_ptr<Files::File>> Files::FilesPrivate::indexFiles() const {
     };
 
     // Start the indexing
-    for (const QString &rootDir : rootDirs) {
+    for (const QString &rootDir : settings.rootDirs) {
         indexRecursion(QFileInfo(rootDir));
         if (abort) return vector<shared_ptr<Files::File>>();
     }
 
+    // Apply the changes to the offline index and publish it. This is done
+    // here, the GUI thread only swaps the results. The index diffs against
+    // its own items, including those of an index loaded from disk, hence the
+    // unchanged files keep their postings.
+    offlineIndex.assign(newIndex);
+    offlineIndex.commit();
+
     // Serialize data
-    QFile file(QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation)).
-                   filePath(QString("%1.txt").arg(q->Core::Extension::id)));
-    if (file.open(QIODevice::WriteOnly|QIODevice::Text)) {
-        qDebug() << qPrintable(QString("Serializing files to '%1'").arg(file.fileName()));
-        QTextStream out(&file);
-        for (const shared_ptr<File> &item : newIndex)
-            out << item->path() << endl << item->mimetype().name() << endl;
-    } else
-        qWarning() << qPrintable(QString("Could not write to file '%1': %2").arg(file.fileName(), file.errorString()));
+    const QString indexPath = QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation)).
+            filePath(QString("%1.index").arg(q->Core::Extension::id));
+    qDebug() << qPrintable(QString("Serializing files to '%1'").arg(indexPath));
+    if (!offlineIndex.save(indexPath, [](const Core::Indexable &item){
+                               return static_cast<const File&>(item).mimetype().name();
+                           }))
+        qWarning() << qPrintable(QString("Could not write to file '%1'").arg(indexPath));
 
     return newIndex;
 }
@@ -290,29 +308,22 @@ Files::Extension::Extension()
     d->indexHidden = s.value(CFG_INDEX_HIDDEN, DEF_INDEX_HIDDEN).toBool();
     d->followSymlinks = s.value(CFG_FOLLOW_SYMLINKS, DEF_FOLLOW_SYMLINKS).toBool();
     d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    d->offlineIndex.setFoldDiacritics();
     d->indexIntervalTimer.setInterval(s.value(CFG_SCAN_INTERVAL, DEF_SCAN_INTERVAL).toInt()*60000); // Will be started in the initial index update
     d->rootDirs = s.value(CFG_PATHS).toStringList();
     if (d->rootDirs.isEmpty())
         restorePaths();
     s.endGroup();
 
-    // Deserialize data
-    QFile file(QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation)).
-                   filePath(QString("%1.txt").arg(Core::Extension::id)));
-    if (file.exists()) {
-        if (file.open(QIODevice::ReadOnly| QIODevice::Text)) {
-            qDebug() << qPrintable(QString("Deserializing files from '%1'.").arg(file.fileName()));
-            QTextStream in(&file);
-            QMimeDatabase mimedatabase;
-            while (!in.atEnd())
-                d->index.emplace_back(new File(in.readLine(), mimedatabase.mimeTypeForName(in.readLine())));
-            file.close();
-
-            // Build the offline index
-            for (const auto &item : d->index)
-                d->offlineIndex.add(item);
-        } else
-            qWarning() << qPrintable(QString("Could not read from file '%1': %2").arg(file.fileName(), file.errorString()));
+    // Map the index of the last run, the files are created when they match
+    const QString indexPath = QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation)).
+            filePath(QString("%1.index").arg(Core::Extension::id));
+    if (QFile::exists(indexPath)) {
+        qDebug() << qPrintable(QString("Mapping files from '%1'.").arg(indexPath));
+        if (!d->offlineIndex.load(indexPath, [](const QString &path, const QString &mimetype){
+                                      return std::make_shared<File>(path, QMimeDatabase().mimeTypeForName(mimetype));
+                                  }))
+            qWarning() << qPrintable(QString("Could not read from file '%1'").arg(indexPath));
     }
 
     // Index timer
@@ -396,8 +407,14 @@ QWidget *Files::Extension::widget(QWidget *parent) {
 
 /** ***************************************************************************/
 void Files::Extension::handleQuery(Core::Query * query) {
+    handleRefinement(query, nullptr);
+}
 
 
+
+/** ***************************************************************************/
+void Files::Extension::handleRefinement(Core::Query * query, shared_ptr<void> state) {
+
     if ( query->searchTerm().startsWith('/') || query->searchTerm().startsWith("~/") ) {
 
         QFileInfo fileInfo(query->searchTerm());
@@ -411,7 +428,7 @@ void Files::Extension::handleQuery(Core::Query * query) {
         if ( pathInfo.exists() && pathInfo.isDir() ) {
             QMimeDatabase mimeDatabase;
             QDirIterator dirIterator(pathInfo.filePath(), QDir::AllEntries|QDir::Hidden|QDir::NoDotAndDotDot);
-            while (dirIterator.hasNext()) {
+            while (dirIterator.hasNext() && query->isValid()) {
                 dirIterator.next();
                 if ( dirIterator.fileName().startsWith(fileInfo.fileName()) ) {
                     QMimeType mimetype = mimeDatabase.mimeTypeForFile(dirIterator.filePath());
@@ -441,14 +458,17 @@ void Files::Extension::handleQuery(Core::Query * query) {
         query->addMatch(standardItem);
     }
 
-    // Search for matches
-    const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
+    // Search for the best matches, reuse the work done for the previous term
+    shared_ptr<Core::OfflineIndex::Refinement> refinement = std::static_pointer_cast<Core::OfflineIndex::Refinement>(state);
+    const vector<pair<shared_ptr<Core::Indexable>,short>> &indexables = d->offlineIndex.refineScored(query->searchTerm(), MAX_RESULTS, refinement,
+                                                                                                     &query->cancellationToken());
+    query->setRefinementState(this, refinement);
 
     // Add results to query
     vector<pair<shared_ptr<Core::Item>,short>> results;
-    for (const shared_ptr<Core::Indexable> &item : indexables)
-        // TODO `Search` has to determine the relevance. Set to 0 for now
-        results.emplace_back(std::static_pointer_cast<File>(item), -1);
+    results.reserve(indexables.size());
+    for (const pair<shared_ptr<Core::Indexable>,short> &item : indexables)
+        results.emplace_back(std::static_pointer_cast<File>(item.first), item.second);
 
     query->addMatches(results.begin(), results.end());
 }
@@ -663,4 +683,5 @@ bool Files::Extension::fuzzy() {
 /** ***************************************************************************/
 void Files::Extension::setFuzzy(bool b) {
     QSettings(qApp->applicationName()).setValue(QString("%1/%2").arg(Core::Extension::id, CFG_FUZZY), b);
+    d->offlineIndex.setFuzzy(b);
 }
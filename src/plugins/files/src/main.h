@@ -45,6 +45,8 @@ public:
     QString name() const override { return "Files"; }
     QWidget *widget(QWidget *parent = nullptr) override;
     void handleQuery(Core::Query * query) override;
+    bool refinesQueries() const override { return true; }
+    void handleRefinement(Core::Query * query, std::shared_ptr<void> state) override;
 
     /*
      * Extension specific members
@@ -18,7 +18,6 @@
 #include <QApplication>
 #include <QCheckBox>
 #include <QClipboard>
-#include <QtConcurrent>
 #include <QComboBox>
 #include <QDebug>
 #include <QDesktopServices>
@@ -35,7 +34,6 @@
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QStandardPaths>
-#include <QThreadPool>
 #include <QUrl>
 #include <functional>
 #include <map>
@@ -47,6 +45,7 @@
 #include "standardaction.h"
 #include "standardindexitem.h"
 #include "query.h"
+#include "queryexecutor.h"
 #include "xdgiconlookup.h"
 using std::pair;
 using std::shared_ptr;
@@ -60,6 +59,7 @@ const bool    DEF_FUZZY   = false;
 const QString CFG_USE_FIREFOX   = "openWithFirefox";
 const bool    DEF_USE_FIREFOX   = false;
 const uint    UPDATE_DELAY = 60000;
+const QString INDEXER_CONNECTION = "org.albert.extension.firefoxbookmarks.indexer";
 }
 
 
@@ -89,7 +89,12 @@ public:
     void startIndexing();
     void finishIndexing();
     QFutureWatcher<vector<shared_ptr<Core::StandardIndexItem>>> futureWatcher;
-    std::vector<std::shared_ptr<Core::StandardIndexItem>> indexFirefoxBookmarks() const;
+    static std::vector<std::shared_ptr<Core::StandardIndexItem>> indexFirefoxBookmarks(const QString &databasePath,
+                                                                                       const QString &firefoxExecutable,
+                                                                                       bool openWithFirefox);
+    static std::vector<std::shared_ptr<Core::StandardIndexItem>> queryBookmarks(QSqlDatabase &database,
+                                                                                const QString &firefoxExecutable,
+                                                                                bool openWithFirefox);
 };
 
 
@@ -105,8 +110,20 @@ void FirefoxBookmarks::FirefoxBookmarksPrivate::startIndexing() {
     QObject::connect(&futureWatcher, &QFutureWatcher<vector<shared_ptr<Core::StandardIndexItem>>>::finished,
                      std::bind(&FirefoxBookmarksPrivate::finishIndexing, this));
 
-    // Run the indexer thread
-    futureWatcher.setFuture(QtConcurrent::run(this, &FirefoxBookmarksPrivate::indexFirefoxBookmarks));
+    // Run the indexer thread, it publishes the offline index too. It gets a
+    // copy of the settings, the offline index is thread safe.
+    const QString databasePath = QSqlDatabase::database(q->Core::Extension::id, false).databaseName();
+    const QString firefoxExecutable = this->firefoxExecutable;
+    const bool openWithFirefox = this->openWithFirefox;
+    Core::OfflineIndex *offlineIndex = &this->offlineIndex;
+    futureWatcher.setFuture(QueryExecutor::instance->run(QueryExecutor::Lane::Background,
+                                                         [databasePath, firefoxExecutable, openWithFirefox, offlineIndex](){
+        vector<shared_ptr<Core::StandardIndexItem>> newIndex
+                = indexFirefoxBookmarks(databasePath, firefoxExecutable, openWithFirefox);
+        offlineIndex->assign(newIndex);
+        offlineIndex->commit();
+        return newIndex;
+    }));
 
     // Notification
     qDebug() << "Start indexing Firefox bookmarks.";
@@ -117,14 +134,9 @@ void FirefoxBookmarks::FirefoxBookmarksPrivate::startIndexing() {
 /** ***************************************************************************/
 void FirefoxBookmarks::FirefoxBookmarksPrivate::finishIndexing() {
 
-    // Get the thread results
+    // Get the thread results, the offline index has been published already
     index = futureWatcher.future().result();
 
-    // Rebuild the offline index
-    offlineIndex.clear();
-    for (const auto &item : index)
-        offlineIndex.add(item);
-
     // Notification
     qDebug() <<  qPrintable(QString("Indexed %1 Firefox bookmarks.").arg(index.size()));
     emit q->statusInfo(QString("%1 bookmarks indexed.").arg(index.size()));
@@ -134,9 +146,28 @@ void FirefoxBookmarks::FirefoxBookmarksPrivate::finishIndexing() {
 
 /** ***************************************************************************/
 vector<shared_ptr<Core::StandardIndexItem>>
-FirefoxBookmarks::FirefoxBookmarksPrivate::indexFirefoxBookmarks() const {
+FirefoxBookmarks::FirefoxBookmarksPrivate::indexFirefoxBookmarks(const QString &databasePath,
+                                                                 const QString &firefoxExecutable,
+                                                                 bool openWithFirefox) {
+
+    // Connections must not be used across threads, the indexer has its own
+    vector<shared_ptr<Core::StandardIndexItem>> bookmarks;
+    {
+        QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", INDEXER_CONNECTION);
+        database.setDatabaseName(databasePath);
+        bookmarks = queryBookmarks(database, firefoxExecutable, openWithFirefox);
+    }
+    QSqlDatabase::removeDatabase(INDEXER_CONNECTION);
+    return bookmarks;
+}
+
 
-    QSqlDatabase database = QSqlDatabase::database(q->Core::Extension::id);
+
+/** ***************************************************************************/
+vector<shared_ptr<Core::StandardIndexItem>>
+FirefoxBookmarks::FirefoxBookmarksPrivate::queryBookmarks(QSqlDatabase &database,
+                                                          const QString &firefoxExecutable,
+                                                          bool openWithFirefox) {
 
     if (!database.open()) {
         qWarning() << qPrintable(QString("Could not open Firefox database: %1").arg(database.databaseName()));
@@ -196,7 +227,7 @@ FirefoxBookmarks::FirefoxBookmarksPrivate::indexFirefoxBookmarks() const {
 
         shared_ptr<StandardAction> actionFirefox = std::make_shared<StandardAction>();
         actionFirefox->setText("Open URL in Firefox");
-        actionFirefox->setAction([urlstr, this](){
+        actionFirefox->setAction([urlstr, firefoxExecutable](){
             QProcess::startDetached(firefoxExecutable, {urlstr});
         });
 
@@ -261,6 +292,7 @@ FirefoxBookmarks::Extension::Extension()
     s.beginGroup(Core::Extension::id);
     d->currentProfileId = s.value(CFG_PROFILE).toString();
     d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    d->offlineIndex.setFoldDiacritics();
     d->openWithFirefox = s.value(CFG_USE_FIREFOX, DEF_USE_FIREFOX).toBool();
 
     // If the id does not exist find a proper default
@@ -316,7 +348,7 @@ FirefoxBookmarks::Extension::Extension()
 
 /** ***************************************************************************/
 FirefoxBookmarks::Extension::~Extension() {
-
+    d->futureWatcher.waitForFinished();
 }
 
 
@@ -379,12 +411,13 @@ QWidget *FirefoxBookmarks::Extension::widget(QWidget *parent) {
 void FirefoxBookmarks::Extension::handleQuery(Core::Query *query) {
 
     // Search for matches
-    const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
+    const vector<pair<shared_ptr<Core::Indexable>,short>> &indexables = d->offlineIndex.searchScored(query->searchTerm(), SIZE_MAX, nullptr,
+                                                                                                     &query->cancellationToken());
 
     // Add results to query.
     vector<pair<shared_ptr<Core::Item>,short>> results;
-    for (const shared_ptr<Core::Indexable> &item : indexables)
-        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item), 0);
+    for (const pair<shared_ptr<Core::Indexable>,short> &item : indexables)
+        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item.first), item.second);
 
     query->addMatches(results.begin(), results.end());
 }